@@ -0,0 +1,974 @@
+# include <algorithm>
+# include <cstring>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+
+# include <arrow-ipc.H>
+# include <quantity-array.H>
+# include <conversion-stream.H>
+
+// Identifiers of the Arrow flatbuffers schemas (Message.fbs, Schema.fbs,
+// File.fbs). A table field is referenced by its position in the schema
+// declaration; a union takes two positions (type and value)
+
+static const int16_t Metadata_V4 = 3, Metadata_V5 = 4;
+
+enum MessageHeader : uint8_t { Header_Schema = 1, Header_Dictionary = 2,
+			       Header_RecordBatch = 3 };
+
+static const uint32_t Continuation = 0xFFFFFFFF;
+
+static const char Magic[] = "ARROW1";
+static const size_t Magic_Size = 6;
+
+[[noreturn]] static void invalid(const string & msg)
+{
+  ZENTHROW(InvalidArrowData, msg);
+}
+
+// Layout of the supported types: number of buffers of a column and
+// scalar parameters of the type table as (field id, size in bytes)
+struct TypeLayout
+{
+  ArrowTypeId id;
+  const char * name;
+  int num_buffers;
+  vector<pair<int, int>> params;
+};
+
+static const vector<TypeLayout> & type_layouts()
+{
+  static const vector<TypeLayout> layouts =
+    {
+      { ArrowTypeId::Null, "null", 0, {} },
+      { ArrowTypeId::Int, "int", 2, {{0, 4}, {1, 1}} },
+      { ArrowTypeId::FloatingPoint, "floating point", 2, {{0, 2}} },
+      { ArrowTypeId::Binary, "binary", 3, {} },
+      { ArrowTypeId::Utf8, "utf8", 3, {} },
+      { ArrowTypeId::Bool, "bool", 2, {} },
+      { ArrowTypeId::Decimal, "decimal", 2, {{0, 4}, {1, 4}, {2, 4}} },
+      { ArrowTypeId::Date, "date", 2, {{0, 2}} },
+      { ArrowTypeId::Time, "time", 2, {{0, 2}, {1, 4}} },
+      { ArrowTypeId::Timestamp, "timestamp", 2, {{0, 2}} }, // + timezone
+      { ArrowTypeId::Interval, "interval", 2, {{0, 2}} },
+      { ArrowTypeId::FixedSizeBinary, "fixed size binary", 2, {{0, 4}} },
+      { ArrowTypeId::Duration, "duration", 2, {{0, 2}} },
+      { ArrowTypeId::LargeBinary, "large binary", 3, {} },
+      { ArrowTypeId::LargeUtf8, "large utf8", 3, {} },
+    };
+  return layouts;
+}
+
+static const TypeLayout & type_layout(uint8_t id)
+{
+  for (const auto & layout : type_layouts())
+    if (uint8_t(layout.id) == id)
+      return layout;
+
+  ostringstream s;
+  s << "unsupported arrow type " << int(id)
+    << " (only flat primitive and binary types are supported)";
+  invalid(s.str());
+}
+
+// Read access to a flatbuffer table with bounds checking
+class FbTable
+{
+  const uint8_t * base;
+  size_t size;
+  size_t pos;
+  size_t vtable;
+  size_t vtable_size;
+
+  void check(size_t p, size_t len) const
+  {
+    if (p > size or len > size - p)
+      invalid("flatbuffer offset out of bounds");
+  }
+
+  template <typename T> T read(size_t p) const
+  {
+    check(p, sizeof(T));
+    T val;
+    memcpy(&val, base + p, sizeof(T));
+    return val;
+  }
+
+  size_t field_pos(int id) const
+  {
+    const size_t entry = 4 + 2*id;
+    if (entry + 2 > vtable_size)
+      return 0;
+    const uint16_t off = read<uint16_t>(vtable + entry);
+    return off == 0 ? 0 : pos + off;
+  }
+
+  size_t target(int id) const
+  {
+    const size_t p = field_pos(id);
+    if (p == 0)
+      return 0;
+    const size_t tgt = p + read<uint32_t>(p);
+    check(tgt, 4);
+    return tgt;
+  }
+
+public:
+
+  FbTable(const uint8_t * base, size_t size, size_t pos)
+    : base(base), size(size), pos(pos)
+  {
+    const int64_t vt = int64_t(pos) - read<int32_t>(pos);
+    if (vt < 0)
+      invalid("flatbuffer vtable out of bounds");
+    vtable = vt;
+    vtable_size = read<uint16_t>(vtable);
+    check(vtable, vtable_size);
+  }
+
+  /// The root table of the flatbuffer [base, base + size)
+  static FbTable root(const uint8_t * base, size_t size)
+  {
+    if (size < 4)
+      invalid("flatbuffer too short");
+    uint32_t off;
+    memcpy(&off, base, 4);
+    return FbTable(base, size, off);
+  }
+
+  bool has(int id) const { return field_pos(id) != 0; }
+
+  template <typename T> T scalar(int id, T dft = T()) const
+  {
+    const size_t p = field_pos(id);
+    return p == 0 ? dft : read<T>(p);
+  }
+
+  // sign extended integer of size bytes
+  int64_t integer(int id, int size) const
+  {
+    switch (size)
+      {
+      case 1: return scalar<uint8_t>(id);
+      case 2: return scalar<int16_t>(id);
+      case 4: return scalar<int32_t>(id);
+      default: return scalar<int64_t>(id);
+      }
+  }
+
+  FbTable table(int id) const
+  {
+    const size_t p = target(id);
+    if (p == 0)
+      invalid("missing flatbuffer table");
+    return FbTable(base, size, p);
+  }
+
+  string str(int id) const
+  {
+    const size_t p = target(id);
+    if (p == 0)
+      return string();
+    const uint32_t len = read<uint32_t>(p);
+    check(p + 4, len);
+    return string(reinterpret_cast<const char*>(base) + p + 4, len);
+  }
+
+  // position of the first element of a vector and its length
+  size_t vector_of(int id, size_t elem_size, size_t & n) const
+  {
+    n = 0;
+    const size_t p = target(id);
+    if (p == 0)
+      return 0;
+    n = read<uint32_t>(p);
+    if (n > (size - p - 4)/max<size_t>(elem_size, 1))
+      invalid("flatbuffer vector out of bounds");
+    return p + 4;
+  }
+
+  FbTable table_at(size_t slot) const
+  {
+    return FbTable(base, size, slot + read<uint32_t>(slot));
+  }
+
+  template <typename T> T read_at(size_t p) const { return read<T>(p); }
+};
+
+static vector<pair<string, string>> decode_metadata(const FbTable & table,
+						    int id)
+{
+  vector<pair<string, string>> ret;
+  size_t n;
+  const size_t p = table.vector_of(id, 4, n);
+  for (size_t i = 0; i < n; ++i)
+    {
+      const FbTable kv = table.table_at(p + 4*i);
+      ret.emplace_back(kv.str(0), kv.str(1));
+    }
+  return ret;
+}
+
+static ArrowField decode_field(const FbTable & f)
+{
+  ArrowField field;
+  field.name = f.str(0);
+  field.nullable = f.scalar<uint8_t>(1, 0);
+  const uint8_t type_id = f.scalar<uint8_t>(2, 0);
+  const TypeLayout & layout = type_layout(type_id);
+  field.type = layout.id;
+
+  if (f.has(4))
+    invalid("field " + field.name + " is dictionary encoded (not supported)");
+  size_t num_children;
+  f.vector_of(5, 4, num_children);
+  if (num_children > 0)
+    invalid("field " + field.name + " has children (not supported)");
+
+  if (f.has(3))
+    {
+      const FbTable type = f.table(3);
+      for (const auto & param : layout.params)
+	if (type.has(param.first))
+	  field.type_params.emplace_back(param.first,
+					 type.integer(param.first,
+						      param.second));
+      if (layout.id == ArrowTypeId::Timestamp)
+	field.timezone = type.str(1);
+    }
+
+  field.metadata = decode_metadata(f, 6);
+  return field;
+}
+
+static void decode_schema(const FbTable & schema, ArrowTable & table)
+{
+  if (schema.scalar<int16_t>(0, 0) != 0)
+    invalid("big-endian arrow data is not supported");
+
+  size_t n;
+  const size_t p = schema.vector_of(1, 4, n);
+  for (size_t i = 0; i < n; ++i)
+    table.fields.push_back(decode_field(schema.table_at(p + 4*i)));
+  table.metadata = decode_metadata(schema, 2);
+}
+
+static void decode_batch(const FbTable & batch, const uint8_t * body,
+			 size_t body_size, const shared_ptr<const void> & owner,
+			 ArrowTable & table)
+{
+  if (batch.has(3))
+    invalid("compressed record batches are not supported");
+
+  ArrowRecordBatch ret;
+  ret.length = batch.scalar<int64_t>(0, 0);
+
+  size_t num_nodes, num_buffers;
+  const size_t nodes = batch.vector_of(1, 16, num_nodes);
+  const size_t buffers = batch.vector_of(2, 16, num_buffers);
+  if (num_nodes != table.fields.size())
+    invalid("number of columns of a record batch differs from the schema");
+
+  size_t b = 0;
+  for (size_t i = 0; i < num_nodes; ++i)
+    {
+      ArrowColumn col;
+      col.length = batch.read_at<int64_t>(nodes + 16*i);
+      col.null_count = batch.read_at<int64_t>(nodes + 16*i + 8);
+      const int nbuf = type_layout(uint8_t(table.fields[i].type)).num_buffers;
+      for (int k = 0; k < nbuf; ++k, ++b)
+	{
+	  if (b >= num_buffers)
+	    invalid("missing buffers in record batch");
+	  const int64_t off = batch.read_at<int64_t>(buffers + 16*b);
+	  const int64_t len = batch.read_at<int64_t>(buffers + 16*b + 8);
+	  if (off < 0 or len < 0 or size_t(off) > body_size or
+	      size_t(len) > body_size - off)
+	    invalid("buffer out of the message body");
+	  col.buffers.push_back({ body + off, size_t(len), owner });
+	}
+
+      const size_t value_size = table.fields[i].value_size();
+      if (value_size > 0 and col.buffers.size() == 2 and
+	  col.buffers[1].size < col.length*value_size)
+	invalid("data buffer of column " + table.fields[i].name +
+		" is too short");
+      if (col.null_count > 0 and col.buffers.size() > 0 and
+	  col.buffers[0].size*8 < size_t(col.length))
+	invalid("validity bitmap of column " + table.fields[i].name +
+		" is too short");
+
+      ret.columns.push_back(move(col));
+    }
+
+  table.batches.push_back(move(ret));
+}
+
+// Decode the encapsulated message at pos and return the position
+// following its body
+static size_t decode_message(const uint8_t * data, size_t size, size_t pos,
+			     const shared_ptr<const void> & owner,
+			     ArrowTable & table, bool & end)
+{
+  end = true;
+  if (pos + 4 > size)
+    return pos;
+
+  uint32_t len;
+  memcpy(&len, data + pos, 4);
+  pos += 4;
+  if (len == Continuation)
+    {
+      if (pos + 4 > size)
+	invalid("truncated message");
+      memcpy(&len, data + pos, 4);
+      pos += 4;
+    }
+  if (len == 0)
+    return pos;
+  if (len > size - pos)
+    invalid("truncated message metadata");
+
+  const FbTable msg = FbTable::root(data + pos, len);
+  if (msg.scalar<int16_t>(0, 0) < Metadata_V4)
+    invalid("arrow metadata version previous to V4 is not supported");
+  const uint8_t type = msg.scalar<uint8_t>(1, 0);
+  const int64_t body_len = msg.scalar<int64_t>(3, 0);
+  pos += len;
+  if (body_len < 0 or size_t(body_len) > size - pos)
+    invalid("truncated message body");
+
+  switch (type)
+    {
+    case Header_Schema:
+      if (not table.fields.empty())
+	invalid("duplicated schema message");
+      decode_schema(msg.table(2), table);
+      break;
+    case Header_RecordBatch:
+      decode_batch(msg.table(2), data + pos, body_len, owner, table);
+      break;
+    case Header_Dictionary:
+      invalid("dictionary batches are not supported");
+    default:
+      invalid("unsupported arrow message");
+    }
+
+  end = false;
+  return pos + body_len;
+}
+
+ArrowTable ArrowTable::decode(const uint8_t * data, size_t size,
+			      shared_ptr<const void> owner)
+{
+  ArrowTable table;
+  const bool file_format = size >= 8 + Magic_Size and
+    memcmp(data, Magic, Magic_Size) == 0;
+
+  if (not file_format)
+    {
+      if (size < 8)
+	invalid("arrow data too short");
+      bool end = false;
+      for (size_t pos = 0; not end; )
+	pos = decode_message(data, size, pos, owner, table, end);
+      return table;
+    }
+
+  // file format: the footer gives the schema and the record batches
+  if (memcmp(data + size - Magic_Size, Magic, Magic_Size) != 0)
+    invalid("missing trailing magic of arrow file");
+  int32_t footer_len;
+  memcpy(&footer_len, data + size - Magic_Size - 4, 4);
+  if (footer_len <= 0 or size_t(footer_len) > size - Magic_Size - 4 - 8)
+    invalid("invalid arrow file footer");
+  const uint8_t * footer_data = data + size - Magic_Size - 4 - footer_len;
+  const FbTable footer = FbTable::root(footer_data, footer_len);
+
+  decode_schema(footer.table(1), table);
+
+  size_t n;
+  footer.vector_of(2, 24, n);
+  if (n > 0)
+    invalid("dictionary batches are not supported");
+
+  const size_t blocks = footer.vector_of(3, 24, n);
+  for (size_t i = 0; i < n; ++i)
+    {
+      const int64_t offset = footer.read_at<int64_t>(blocks + 24*i);
+      if (offset < 0 or size_t(offset) >= size)
+	invalid("record batch block out of file");
+      ArrowTable batch_table;
+      batch_table.fields = table.fields;
+      bool end;
+      decode_message(data, size, offset, owner, batch_table, end);
+      if (batch_table.batches.size() != 1)
+	invalid("block does not point to a record batch");
+      table.batches.push_back(move(batch_table.batches.front()));
+    }
+
+  return table;
+}
+
+ArrowTable ArrowTable::read(const string & file_name)
+{
+  auto io_error = [&file_name] (const char * what)
+    {
+      ostringstream s;
+      s << what << " " << file_name << ": " << strerror(errno);
+      ZENTHROW(IOError, s.str());
+    };
+
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0)
+    io_error("cannot open");
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    {
+      close(fd);
+      io_error("cannot stat");
+    }
+
+  const size_t size = st.st_size;
+  if (size == 0)
+    {
+      close(fd);
+      invalid(file_name + " is empty");
+    }
+
+  void * addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    io_error("cannot map");
+
+  shared_ptr<const void> owner(addr, [size] (const void * p)
+			       {
+				 munmap(const_cast<void*>(p), size);
+			       });
+  return decode(static_cast<const uint8_t*>(addr), size, owner);
+}
+
+// Builder of flatbuffers in increasing address order. Every uoffset
+// must point forward, so a table is written before its children and
+// its offset fields are patched when the children are written
+class FbBuilder
+{
+public:
+
+  struct Slot
+  {
+    int id;
+    int size;              // bytes of the scalar or 4 for offsets
+    int64_t value;
+    bool offset;
+  };
+
+  vector<uint8_t> buf = vector<uint8_t>(4); // root offset
+
+  size_t size() const noexcept { return buf.size(); }
+
+  void pad(size_t align, size_t extra = 0)
+  {
+    while ((buf.size() + extra) % align != 0)
+      buf.push_back(0);
+  }
+
+  template <typename T> void put(T val)
+  {
+    const size_t p = buf.size();
+    buf.resize(p + sizeof(T));
+    memcpy(&buf[p], &val, sizeof(T));
+  }
+
+  // make the offset stored in slot point to target
+  void link(size_t slot, size_t target)
+  {
+    const uint32_t off = target - slot;
+    memcpy(&buf[slot], &off, 4);
+  }
+
+  void set_root(size_t table) { link(0, table); }
+
+  // Write a vtable followed by its table and return the table
+  // position. offset_at[i] receives the position of slots[i] if it is
+  // an offset
+  size_t table(const vector<Slot> & slots, vector<size_t> & offset_at)
+  {
+    int num_ids = 0;
+    for (const auto & s : slots)
+      num_ids = max(num_ids, s.id + 1);
+
+    vector<size_t> order(slots.size());
+    for (size_t i = 0; i < order.size(); ++i)
+      order[i] = i;
+    stable_sort(order.begin(), order.end(), [&slots] (size_t i, size_t j)
+		{
+		  return slots[i].size > slots[j].size;
+		});
+
+    vector<uint16_t> field_off(num_ids, 0);
+    size_t cur = 4; // after the vtable soffset
+    for (auto i : order)
+      {
+	const size_t sz = slots[i].size;
+	cur = (cur + sz - 1)/sz*sz;
+	field_off[slots[i].id] = cur;
+	cur += sz;
+      }
+    const size_t table_size = (cur + 3)/4*4;
+    const size_t vtable_size = 4 + 2*num_ids;
+
+    pad(8, vtable_size); // the table is 8 aligned
+    const size_t vtable = size();
+    put<uint16_t>(vtable_size);
+    put<uint16_t>(table_size);
+    for (auto off : field_off)
+      put<uint16_t>(off);
+
+    const size_t table = size();
+    put<int32_t>(table - vtable);
+    buf.resize(table + table_size, 0);
+
+    offset_at.assign(slots.size(), 0);
+    for (size_t i = 0; i < slots.size(); ++i)
+      {
+	const size_t p = table + field_off[slots[i].id];
+	if (slots[i].offset)
+	  offset_at[i] = p;
+	else
+	  memcpy(&buf[p], &slots[i].value, slots[i].size); // little-endian
+      }
+
+    return table;
+  }
+
+  size_t str(const string & s)
+  {
+    pad(4);
+    const size_t p = size();
+    put<uint32_t>(s.size());
+    buf.insert(buf.end(), s.begin(), s.end());
+    buf.push_back(0);
+    return p;
+  }
+
+  // vector of n offsets; slots receives their positions
+  size_t offset_vector(size_t n, vector<size_t> & slots)
+  {
+    pad(4);
+    const size_t p = size();
+    put<uint32_t>(n);
+    slots.clear();
+    for (size_t i = 0; i < n; ++i)
+      {
+	slots.push_back(size());
+	put<uint32_t>(0);
+      }
+    return p;
+  }
+
+  // vector of n structs of elem_size bytes aligned to 8
+  size_t struct_vector(const void * data, size_t n, size_t elem_size)
+  {
+    pad(8, 4);
+    const size_t p = size();
+    put<uint32_t>(n);
+    const uint8_t * bytes = static_cast<const uint8_t*>(data);
+    buf.insert(buf.end(), bytes, bytes + n*elem_size);
+    return p;
+  }
+};
+
+static void encode_metadata(FbBuilder & fb, size_t slot,
+			    const vector<pair<string, string>> & metadata)
+{
+  vector<size_t> slots, kv_slots;
+  fb.link(slot, fb.offset_vector(metadata.size(), slots));
+  for (size_t i = 0; i < metadata.size(); ++i)
+    {
+      fb.link(slots[i], fb.table({{0, 4, 0, true}, {1, 4, 0, true}},
+				 kv_slots));
+      fb.link(kv_slots[0], fb.str(metadata[i].first));
+      fb.link(kv_slots[1], fb.str(metadata[i].second));
+    }
+}
+
+static size_t encode_field(FbBuilder & fb, const ArrowField & field)
+{
+  vector<FbBuilder::Slot> slots =
+    {
+      { 0, 4, 0, true },                     // name
+      { 1, 1, field.nullable, false },       // nullable
+      { 2, 1, int64_t(field.type), false },  // type_type
+      { 3, 4, 0, true },                     // type
+      { 5, 4, 0, true },                     // children
+    };
+  if (not field.metadata.empty())
+    slots.push_back({ 6, 4, 0, true });      // custom_metadata
+
+  vector<size_t> offs;
+  const size_t table = fb.table(slots, offs);
+
+  fb.link(offs[0], fb.str(field.name));
+
+  const TypeLayout & layout = type_layout(uint8_t(field.type));
+  vector<FbBuilder::Slot> type_slots;
+  for (const auto & param : field.type_params)
+    for (const auto & p : layout.params)
+      if (p.first == param.first)
+	type_slots.push_back({ param.first, p.second, param.second, false });
+  const bool has_tz = layout.id == ArrowTypeId::Timestamp and
+    not field.timezone.empty();
+  if (has_tz)
+    type_slots.push_back({ 1, 4, 0, true });
+  vector<size_t> type_offs;
+  fb.link(offs[3], fb.table(type_slots, type_offs));
+  if (has_tz)
+    fb.link(type_offs.back(), fb.str(field.timezone));
+
+  vector<size_t> no_children;
+  fb.link(offs[4], fb.offset_vector(0, no_children));
+
+  if (not field.metadata.empty())
+    encode_metadata(fb, offs[5], field.metadata);
+
+  return table;
+}
+
+static size_t encode_schema(FbBuilder & fb, const ArrowTable & table)
+{
+  vector<FbBuilder::Slot> slots =
+    {
+      { 0, 2, 0, false },  // endianness: little
+      { 1, 4, 0, true },   // fields
+    };
+  if (not table.metadata.empty())
+    slots.push_back({ 2, 4, 0, true });
+
+  vector<size_t> offs, field_slots;
+  const size_t schema = fb.table(slots, offs);
+  fb.link(offs[1], fb.offset_vector(table.fields.size(), field_slots));
+  for (size_t i = 0; i < table.fields.size(); ++i)
+    fb.link(field_slots[i], encode_field(fb, table.fields[i]));
+  if (not table.metadata.empty())
+    encode_metadata(fb, offs[2], table.metadata);
+
+  return schema;
+}
+
+// Message flatbuffer whose header is written by write_header
+template <class WriteHeader>
+static vector<uint8_t> encode_message(MessageHeader type, int64_t body_len,
+				      WriteHeader write_header)
+{
+  FbBuilder fb;
+  vector<size_t> offs;
+  fb.set_root(fb.table({
+	{ 0, 2, Metadata_V5, false },  // version
+	{ 1, 1, type, false },         // header_type
+	{ 2, 4, 0, true },             // header
+	{ 3, 8, body_len, false },     // bodyLength
+      }, offs));
+  fb.link(offs[2], write_header(fb));
+  return move(fb.buf);
+}
+
+struct Block
+{
+  int64_t offset;
+  int32_t meta_len;
+  int32_t padding;
+  int64_t body_len;
+};
+
+template <typename T> static void put(vector<uint8_t> & out, T val)
+{
+  const size_t p = out.size();
+  out.resize(p + sizeof(T));
+  memcpy(&out[p], &val, sizeof(T));
+}
+
+static void pad8(vector<uint8_t> & out)
+{
+  out.resize((out.size() + 7)/8*8, 0);
+}
+
+// Append the encapsulated message and return its block
+static Block put_message(vector<uint8_t> & out,
+			 const vector<uint8_t> & metadata,
+			 const vector<uint8_t> & body)
+{
+  Block block;
+  block.offset = out.size();
+  block.padding = 0;
+  put<uint32_t>(out, Continuation);
+  const size_t len = (metadata.size() + 7)/8*8;
+  put<int32_t>(out, len);
+  out.insert(out.end(), metadata.begin(), metadata.end());
+  out.resize(block.offset + 8 + len, 0);
+  out.insert(out.end(), body.begin(), body.end());
+  block.meta_len = 8 + len;
+  block.body_len = body.size();
+  return block;
+}
+
+vector<uint8_t> ArrowTable::encode(bool stream) const
+{
+  vector<uint8_t> out;
+  if (not stream)
+    {
+      out.insert(out.end(), Magic, Magic + Magic_Size);
+      pad8(out);
+    }
+
+  put_message(out, encode_message(Header_Schema, 0, [this] (FbBuilder & fb)
+				  {
+				    return encode_schema(fb, *this);
+				  }), {});
+
+  vector<Block> blocks;
+  vector<uint8_t> body;
+  for (const auto & batch : batches)
+    {
+      struct { int64_t length, null_count; } node;
+      vector<decltype(node)> nodes;
+      struct { int64_t offset, length; } buffer;
+      vector<decltype(buffer)> buffers;
+      body.clear();
+      for (const auto & col : batch.columns)
+	{
+	  nodes.push_back({col.length, col.null_count});
+	  for (const auto & b : col.buffers)
+	    {
+	      buffers.push_back({int64_t(body.size()), int64_t(b.size)});
+	      body.insert(body.end(), b.data, b.data + b.size);
+	      pad8(body);
+	    }
+	}
+
+      auto metadata = encode_message(Header_RecordBatch, body.size(),
+				     [&] (FbBuilder & fb)
+	{
+	  vector<size_t> offs;
+	  const size_t rb = fb.table({
+	      { 0, 8, batch.length, false },  // length
+	      { 1, 4, 0, true },              // nodes
+	      { 2, 4, 0, true },              // buffers
+	    }, offs);
+	  fb.link(offs[1], fb.struct_vector(nodes.data(), nodes.size(), 16));
+	  fb.link(offs[2], fb.struct_vector(buffers.data(), buffers.size(), 16));
+	  return rb;
+	});
+      blocks.push_back(put_message(out, metadata, body));
+    }
+
+  put<uint32_t>(out, Continuation); // end of stream
+  put<int32_t>(out, 0);
+  if (stream)
+    return out;
+
+  FbBuilder fb;
+  vector<size_t> offs;
+  fb.set_root(fb.table({
+	{ 0, 2, Metadata_V5, false },  // version
+	{ 1, 4, 0, true },             // schema
+	{ 2, 4, 0, true },             // dictionaries
+	{ 3, 4, 0, true },             // recordBatches
+      }, offs));
+  fb.link(offs[1], encode_schema(fb, *this));
+  fb.link(offs[2], fb.struct_vector(nullptr, 0, 24));
+  fb.link(offs[3], fb.struct_vector(blocks.data(), blocks.size(), 24));
+
+  out.insert(out.end(), fb.buf.begin(), fb.buf.end());
+  put<int32_t>(out, fb.buf.size());
+  out.insert(out.end(), Magic, Magic + Magic_Size);
+
+  return out;
+}
+
+void ArrowTable::write(const string & file_name) const
+{
+  const int fd = open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    {
+      ostringstream s;
+      s << "cannot open " << file_name << ": " << strerror(errno);
+      ZENTHROW(IOError, s.str());
+    }
+
+  const vector<uint8_t> data = encode();
+  try
+    {
+      write_fully(fd, reinterpret_cast<const char*>(data.data()), data.size());
+    }
+  catch (...)
+    {
+      close(fd);
+      throw;
+    }
+  close(fd);
+}
+
+ArrowField ArrowField::floating_point(const string & name, ArrowPrecision prec)
+{
+  ArrowField field;
+  field.name = name;
+  field.type = ArrowTypeId::FloatingPoint;
+  field.type_params = { {0, int64_t(prec)} };
+  return field;
+}
+
+static const string Unit_Key = "zen.unit";
+
+const Unit * ArrowField::unit() const
+{
+  for (const auto & kv : metadata)
+    if (kv.first == Unit_Key)
+      {
+	const Unit * ptr = Unit::search_by_symbol(kv.second);
+	return ptr != nullptr ? ptr : Unit::search_by_name(kv.second);
+      }
+  return nullptr;
+}
+
+void ArrowField::set_unit(const Unit & unit)
+{
+  for (auto & kv : metadata)
+    if (kv.first == Unit_Key)
+      {
+	kv.second = unit.symbol;
+	return;
+      }
+  metadata.emplace_back(Unit_Key, unit.symbol);
+}
+
+bool ArrowField::is_floating_point() const noexcept
+{
+  const size_t size = value_size();
+  return type == ArrowTypeId::FloatingPoint and (size == 4 or size == 8);
+}
+
+size_t ArrowField::value_size() const noexcept
+{
+  if (type != ArrowTypeId::FloatingPoint)
+    return 0;
+  ArrowPrecision prec = ArrowPrecision::Half;
+  for (const auto & p : type_params)
+    if (p.first == 0)
+      prec = ArrowPrecision(p.second);
+  switch (prec)
+    {
+    case ArrowPrecision::Half: return 2;
+    case ArrowPrecision::Single: return 4;
+    default: return 8;
+    }
+}
+
+size_t ArrowTable::field_index(const string & name) const
+{
+  for (size_t i = 0; i < fields.size(); ++i)
+    if (fields[i].name == name)
+      return i;
+  invalid("field " + name + " not found");
+}
+
+size_t ArrowTable::num_rows() const noexcept
+{
+  size_t n = 0;
+  for (const auto & batch : batches)
+    n += batch.length;
+  return n;
+}
+
+void ArrowTable::add_column(const string & name, const Unit & unit,
+			    const double * values, size_t n)
+{
+  if (batches.empty())
+    {
+      batches.emplace_back();
+      batches.back().length = n;
+    }
+  if (batches.size() != 1 or batches.front().length != int64_t(n))
+    invalid("add_column() requires a table of a single batch of the same "
+	    "length");
+
+  check_values(unit, values, n);
+
+  ArrowField field = ArrowField::floating_point(name, ArrowPrecision::Double);
+  field.nullable = false;
+  field.set_unit(unit);
+
+  auto data = make_shared<vector<double>>(values, values + n);
+  ArrowColumn col;
+  col.length = n;
+  col.buffers.push_back({}); // no validity bitmap
+  col.buffers.push_back({ reinterpret_cast<const uint8_t*>(data->data()),
+	n*sizeof(double), data });
+
+  fields.push_back(move(field));
+  batches.front().columns.push_back(move(col));
+}
+
+// Validate the non null values of col against unit
+template <typename T>
+static void check_column(const Unit & unit, const T * values,
+			 const ArrowColumn & col)
+{
+  if (col.null_count == 0)
+    {
+      check_values(unit, values, col.length);
+      return;
+    }
+
+  for (int64_t i = 0; i < col.length; ++i)
+    if (col.is_valid(i))
+      check_values(unit, values + i, 1);
+}
+
+template <typename T>
+static ArrowBuffer convert_buffer(const ConversionPlan & plan,
+				  const ArrowColumn & col)
+{
+  const size_t n = col.length;
+  auto out = make_shared<vector<T>>(n);
+  const T * in = reinterpret_cast<const T*>(col.buffers[1].data);
+  if (reinterpret_cast<uintptr_t>(in) % alignof(T) != 0)
+    { // misaligned buffer: convert in place in the new buffer
+      memcpy(out->data(), in, n*sizeof(T));
+      in = out->data();
+    }
+
+  check_column(plan.source_unit(), in, col);
+  plan(in, out->data(), n);
+  check_column(plan.target_unit(), out->data(), col);
+
+  return { reinterpret_cast<const uint8_t*>(out->data()), n*sizeof(T), out };
+}
+
+void ArrowTable::convert_column(const string & name, const Unit & tgt_unit)
+{
+  const size_t idx = field_index(name);
+  ArrowField & field = fields[idx];
+  if (not field.is_floating_point())
+    invalid("field " + name + " is not a float32/float64 column");
+
+  const Unit * src_unit = field.unit();
+  if (src_unit == nullptr)
+    invalid("field " + name + " has not a valid " + Unit_Key + " metadata");
+
+  const ConversionPlan plan(*src_unit, tgt_unit);
+
+  // the table is modified only once every batch has been converted
+  vector<ArrowBuffer> converted;
+  for (const auto & batch : batches)
+    converted.push_back(field.value_size() == 8 ?
+			convert_buffer<double>(plan, batch.columns[idx]) :
+			convert_buffer<float>(plan, batch.columns[idx]));
+
+  for (size_t i = 0; i < batches.size(); ++i)
+    batches[i].columns[idx].buffers[1] = move(converted[i]);
+  field.set_unit(tgt_unit);
+}
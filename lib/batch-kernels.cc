@@ -0,0 +1,124 @@
+# include <batch-kernels.H>
+
+// The variants are generated from the same loop by asking the
+// compiler for a different target on each one; no intrinsics are
+// used, so any platform compiles them. This file is compiled with
+// -ffp-contract=off (see Imakefile): a fused multiply-add in some
+// variants or in the scalar tails of the loops would make the results
+// depend on the kernel and on the position of the value
+
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#   define ZEN_X86_KERNELS 1
+#   define ZEN_AVX2_TARGET __attribute__((target("avx2,fma")))
+#   define ZEN_AVX512_TARGET \
+  __attribute__((target("avx512f,fma,prefer-vector-width=512")))
+# else
+#   define ZEN_AVX2_TARGET
+#   define ZEN_AVX512_TARGET
+# endif
+
+# if defined(__GNUC__) && ! defined(__clang__)
+#   define ZEN_NO_VECTORIZE __attribute__((optimize("no-tree-vectorize")))
+# else
+#   define ZEN_NO_VECTORIZE
+# endif
+
+# define DEFINE_AFFINE_KERNEL(suffix, attr)				\
+  template <typename In, typename Out>					\
+  attr static void affine_##suffix(const In * in, Out * out,		\
+				   size_t n, Out a, Out b) noexcept	\
+  {									\
+    for (size_t i = 0; i < n; ++i)					\
+      out[i] = a*Out(in[i]) + b;					\
+  }
+
+DEFINE_AFFINE_KERNEL(scalar, ZEN_NO_VECTORIZE)
+DEFINE_AFFINE_KERNEL(sse, )
+DEFINE_AFFINE_KERNEL(avx2, ZEN_AVX2_TARGET)
+DEFINE_AFFINE_KERNEL(avx512, ZEN_AVX512_TARGET)
+
+const char * batch_kernel_name(BatchKernel kernel) noexcept
+{
+  switch (kernel)
+    {
+    case BatchKernel::Scalar: return "scalar";
+    case BatchKernel::SSE: return "sse";
+    case BatchKernel::AVX2: return "avx2";
+    case BatchKernel::AVX512: return "avx512";
+    }
+  return "unknown";
+}
+
+bool batch_kernel_supported(BatchKernel kernel) noexcept
+{
+  switch (kernel)
+    {
+    case BatchKernel::Scalar:
+    case BatchKernel::SSE:
+      return true;
+# ifdef ZEN_X86_KERNELS
+    case BatchKernel::AVX2:
+      return __builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma");
+    case BatchKernel::AVX512:
+      return __builtin_cpu_supports("avx512f") and
+	__builtin_cpu_supports("fma");
+# else
+    case BatchKernel::AVX2:
+    case BatchKernel::AVX512:
+      return true;
+# endif
+    }
+  return false;
+}
+
+BatchKernel best_batch_kernel() noexcept
+{
+  static const BatchKernel best =
+    batch_kernel_supported(BatchKernel::AVX512) ? BatchKernel::AVX512 :
+    batch_kernel_supported(BatchKernel::AVX2) ? BatchKernel::AVX2 :
+    BatchKernel::SSE;
+  return best;
+}
+
+template <typename In, typename Out> static inline
+void dispatch_affine(BatchKernel kernel, const In * in, Out * out, size_t n,
+		     Out a, Out b) noexcept
+{
+  switch (kernel)
+    {
+    case BatchKernel::Scalar: affine_scalar(in, out, n, a, b); return;
+    case BatchKernel::SSE: affine_sse(in, out, n, a, b); return;
+    case BatchKernel::AVX2: affine_avx2(in, out, n, a, b); return;
+    case BatchKernel::AVX512: affine_avx512(in, out, n, a, b); return;
+    }
+}
+
+void affine_batch(BatchKernel kernel, const double * in, double * out,
+		  size_t n, double a, double b) noexcept
+{
+  dispatch_affine(kernel, in, out, n, a, b);
+}
+
+void affine_batch(BatchKernel kernel, const float * in, float * out,
+		  size_t n, float a, float b) noexcept
+{
+  dispatch_affine(kernel, in, out, n, a, b);
+}
+
+void affine_batch(BatchKernel kernel, const int16_t * in, double * out,
+		  size_t n, double a, double b) noexcept
+{
+  dispatch_affine(kernel, in, out, n, a, b);
+}
+
+void affine_batch(BatchKernel kernel, const uint16_t * in, double * out,
+		  size_t n, double a, double b) noexcept
+{
+  dispatch_affine(kernel, in, out, n, a, b);
+}
+
+void affine_batch(BatchKernel kernel, const int32_t * in, double * out,
+		  size_t n, double a, double b) noexcept
+{
+  dispatch_affine(kernel, in, out, n, a, b);
+}
@@ -0,0 +1,155 @@
+# include <algorithm>
+# include <mutex>
+# include <vector>
+
+# include <units.H>
+# include <json.hpp>
+
+using json = nlohmann::json;
+
+# ifdef ZEN_CONVERSION_STATS
+
+using PairStats = ConversionStats::PairStats;
+
+// Plain totals of a pair; those of the finished threads are kept here
+struct PairTotals
+{
+  uint64_t calls = 0;
+  uint64_t values = 0;
+  uint64_t sampled = 0;
+  uint64_t buckets[ConversionStats::Num_Buckets] = {};
+
+  void add(const PairStats & s) noexcept
+  {
+    calls += s.calls.load(memory_order_relaxed);
+    values += s.values.load(memory_order_relaxed);
+    sampled += s.sampled.load(memory_order_relaxed);
+    for (size_t i = 0; i < ConversionStats::Num_Buckets; ++i)
+      buckets[i] += s.buckets[i].load(memory_order_relaxed);
+  }
+};
+
+// The registry is only touched by the first conversion of a thread,
+// when the thread finishes and when the statistics are read
+static mutex stats_mutex;
+static vector<ConversionStats::ThreadStats*> live_threads;
+static vector<PairTotals> finished_totals;
+
+static size_t num_pairs(size_t num_units) { return num_units*num_units; }
+
+ConversionStats::ThreadStats::ThreadStats()
+  : num_units(Unit::size()),
+    pairs(new atomic<PairStats*>[num_pairs(num_units)]())
+{
+  lock_guard<mutex> lock(stats_mutex);
+  live_threads.push_back(this);
+}
+
+ConversionStats::ThreadStats::~ThreadStats()
+{
+  lock_guard<mutex> lock(stats_mutex);
+  live_threads.erase(find(live_threads.begin(), live_threads.end(), this));
+  if (finished_totals.size() < num_pairs(num_units))
+    finished_totals.resize(num_pairs(num_units));
+  for (size_t i = 0; i < num_pairs(num_units); ++i)
+    {
+      PairStats * p = pairs[i].load(memory_order_acquire);
+      if (p == nullptr)
+	continue;
+      finished_totals[i].add(*p);
+      delete p;
+    }
+}
+
+string conversion_stats_json()
+{
+  const size_t num_units = Unit::size();
+  vector<const Unit*> units_by_id(num_units);
+  Unit::units().for_each([&units_by_id] (const Unit * ptr)
+			 {
+			   units_by_id[ptr->get_id()] = ptr;
+			 });
+
+  vector<PairTotals> totals(num_pairs(num_units));
+  {
+    lock_guard<mutex> lock(stats_mutex);
+    for (size_t i = 0; i < min(totals.size(), finished_totals.size()); ++i)
+      totals[i] = finished_totals[i];
+    for (auto t : live_threads)
+      for (size_t i = 0; i < min(totals.size(), num_pairs(t->num_units)); ++i)
+	{
+	  const PairStats * p = t->pairs[i].load(memory_order_acquire);
+	  if (p != nullptr)
+	    totals[i].add(*p);
+	}
+  }
+
+  vector<size_t> used;
+  for (size_t i = 0; i < totals.size(); ++i)
+    if (totals[i].calls > 0)
+      used.push_back(i);
+  stable_sort(used.begin(), used.end(), [&totals] (size_t i1, size_t i2)
+	      {
+		return totals[i1].calls > totals[i2].calls;
+	      });
+
+  json pairs = json::array();
+  for (auto i : used)
+    {
+      const PairTotals & t = totals[i];
+      const Unit & src = *units_by_id[i/num_units];
+      const Unit & tgt = *units_by_id[i % num_units];
+      json histogram = json::array();
+      for (size_t b = 0; b < ConversionStats::Num_Buckets; ++b)
+	if (t.buckets[b] > 0)
+	  histogram.push_back({ { "below_ns", uint64_t(1) << b },
+				{ "count", t.buckets[b] } });
+      json p;
+      p["source"] = src.symbol;
+      p["target"] = tgt.symbol;
+      p["physical_quantity"] = src.physical_quantity.name;
+      p["calls"] = t.calls;
+      p["values"] = t.values;
+      p["sampled_calls"] = t.sampled;
+      p["latency_histogram"] = histogram;
+      pairs.push_back(p);
+    }
+
+  json j;
+  j["enabled"] = true;
+  j["sample_period"] = ConversionStats::Sample_Period;
+  j["pairs"] = pairs;
+  return j.dump(2);
+}
+
+void reset_conversion_stats()
+{
+  lock_guard<mutex> lock(stats_mutex);
+  finished_totals.clear();
+  for (auto t : live_threads)
+    for (size_t i = 0; i < num_pairs(t->num_units); ++i)
+      {
+	PairStats * p = t->pairs[i].load(memory_order_acquire);
+	if (p == nullptr)
+	  continue;
+	p->calls.store(0, memory_order_relaxed);
+	p->values.store(0, memory_order_relaxed);
+	p->sampled.store(0, memory_order_relaxed);
+	for (auto & b : p->buckets)
+	  b.store(0, memory_order_relaxed);
+      }
+}
+
+# else // ZEN_CONVERSION_STATS
+
+string conversion_stats_json()
+{
+  json j;
+  j["enabled"] = false;
+  j["pairs"] = json::array();
+  return j.dump(2);
+}
+
+void reset_conversion_stats() {}
+
+# endif // ZEN_CONVERSION_STATS
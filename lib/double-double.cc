@@ -0,0 +1,97 @@
+# include <cmath>
+
+# include <double-double.H>
+
+// This file must be compiled without -ffast-math (see Imakefile):
+// reassociation would cancel the error terms
+
+# ifdef __FAST_MATH__
+#   error "double-double.cc must not be compiled with -ffast-math"
+# endif
+
+// s + e == a + b exactly
+static inline void two_sum(double a, double b, double & s, double & e) noexcept
+{
+  s = a + b;
+  const double bb = s - a;
+  e = (a - (s - bb)) + (b - bb);
+}
+
+// s + e == a + b exactly provided that |a| >= |b|
+static inline void quick_two_sum(double a, double b,
+				 double & s, double & e) noexcept
+{
+  s = a + b;
+  e = b - (s - a);
+}
+
+# ifndef FP_FAST_FMA
+static inline void split(double a, double & hi, double & lo) noexcept
+{
+  static const double splitter = 134217729.0; // 2^27 + 1
+  const double t = splitter*a;
+  hi = t - (t - a);
+  lo = a - hi;
+}
+# endif
+
+// p + e == a*b exactly
+static inline void two_prod(double a, double b, double & p, double & e) noexcept
+{
+  p = a*b;
+# ifdef FP_FAST_FMA
+  e = fma(a, b, -p);
+# else
+  double ahi, alo, bhi, blo;
+  split(a, ahi, alo);
+  split(b, bhi, blo);
+  e = ((ahi*bhi - p) + ahi*blo + alo*bhi) + alo*blo;
+# endif
+}
+
+double DDouble::to_double() const noexcept { return hi + lo; }
+
+DDouble dd_add(const DDouble & x, const DDouble & y) noexcept
+{
+  double s, e, t, f;
+  two_sum(x.hi, y.hi, s, e);
+  two_sum(x.lo, y.lo, t, f);
+  e += t;
+  quick_two_sum(s, e, s, e);
+  e += f;
+  quick_two_sum(s, e, s, e);
+  return DDouble(s, e);
+}
+
+DDouble dd_mul(const DDouble & x, const DDouble & y) noexcept
+{
+  double p, e;
+  two_prod(x.hi, y.hi, p, e);
+  e += x.hi*y.lo + x.lo*y.hi;
+  quick_two_sum(p, e, p, e);
+  return DDouble(p, e);
+}
+
+static inline double affine(const DDouble & a, const DDouble & b,
+			    double x) noexcept
+{
+  double p, e;
+  two_prod(a.hi, x, p, e);
+  e += a.lo*x;
+  double s, f;
+  two_sum(p, b.hi, s, f);
+  f += e + b.lo;
+  return s + f;
+}
+
+double dd_affine(const DDouble & a, const DDouble & b, double x) noexcept
+{
+  return affine(a, b, x);
+}
+
+void dd_affine_batch(const DDouble & a, const DDouble & b,
+		     const double * in, double * out, size_t n) noexcept
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = affine(a, b, in[i]);
+}
@@ -0,0 +1,302 @@
+# include <cfloat>
+# include <cmath>
+# include <cstdint>
+# include <cstdio>
+# include <cstdlib>
+
+# include <number-format.H>
+
+// This file must be compiled without -ffast-math (see Imakefile): the
+// fast path requires correctly rounded multiplications and divisions
+
+# ifdef __FAST_MATH__
+#   error "number-format.cc must not be compiled with -ffast-math"
+# endif
+
+// powers of ten exactly representable as doubles
+static const double exact_pow10[] =
+  {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+static inline bool is_digit(char c) noexcept { return c >= '0' and c <= '9'; }
+
+static const char * slow_parse(const char * begin, double & val) noexcept
+{
+  char * ptr;
+  val = strtod(begin, &ptr);
+  return ptr;
+}
+
+const char * parse_double(const char * begin, const char * end,
+			  double & val) noexcept
+{
+  const char * p = begin;
+  bool negative = false;
+  if (p < end and (*p == '-' or *p == '+'))
+    negative = *p++ == '-';
+
+  uint64_t mantissa = 0;
+  int num_digits = 0; // significant digits in mantissa
+  int exp10 = 0;
+  const char * digits_begin = p;
+
+  while (p < end and *p == '0') // leading zeros are not significant
+    ++p;
+  for (; p < end and is_digit(*p); ++p, ++num_digits)
+    mantissa = 10*mantissa + (*p - '0');
+
+  if (p < end and *p == '.')
+    {
+      ++p;
+      if (num_digits == 0)
+	for (; p < end and *p == '0'; ++p)
+	  --exp10;
+      for (; p < end and is_digit(*p); ++p, ++num_digits, --exp10)
+	mantissa = 10*mantissa + (*p - '0');
+    }
+
+  if (p == digits_begin or (p == digits_begin + 1 and *digits_begin == '.'))
+    return slow_parse(begin, val); // no digits: inf, nan, garbage
+
+  if (p < end and (*p == 'e' or *p == 'E'))
+    {
+      const char * q = p + 1;
+      bool exp_negative = false;
+      if (q < end and (*q == '-' or *q == '+'))
+	exp_negative = *q++ == '-';
+      if (not (q < end and is_digit(*q)))
+	return slow_parse(begin, val);
+      int e = 0;
+      for (; q < end and is_digit(*q); ++q)
+	if (e < 100000)
+	  e = 10*e + (*q - '0');
+      exp10 += exp_negative ? -e : e;
+      p = q;
+    }
+
+  if (p < end and (*p == 'x' or *p == 'X' or *p == 'p' or *p == 'P'))
+    return slow_parse(begin, val); // hexadecimal
+
+  static const uint64_t max_exact_mantissa = uint64_t(1) << 53;
+  if (num_digits > 19 or mantissa > max_exact_mantissa or
+      exp10 < -22 or exp10 > 22)
+    return slow_parse(begin, val);
+
+  double v = double(mantissa);
+  v = exp10 < 0 ? v/exact_pow10[-exp10] : v*exact_pow10[exp10];
+  val = negative ? -v : v;
+
+  return p;
+}
+
+static size_t slow_format(double val, int precision, char * buf) noexcept
+{
+  const int n = snprintf(buf, Max_Double_Length, "%.*g", precision, val);
+  return n < 0 ? 0 : size_t(n);
+}
+
+// powers of ten exactly representable as long doubles (x87 extended
+// precision); where long double is double the extra ones are merely
+// rounded and the rounding test below sends more values to snprintf()
+static const long double exact_pow10l[] =
+  {
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L,
+    1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L,
+    1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+  };
+
+static constexpr int Max_Pow10l = 27;
+
+static inline char * write_digits(uint64_t n, int num_digits, char * buf) noexcept
+{
+  for (int i = num_digits - 1; i >= 0; --i, n /= 10)
+    buf[i] = '0' + n % 10;
+  return buf + num_digits;
+}
+
+// Scale |val| to an integer of precision digits. The product (or
+// quotient) is rounded once, so its relative error is below
+// LDBL_EPSILON; when the scaled value is too close to a rounding tie
+// the direction of the rounding is not certain and the caller falls
+// back to snprintf(), which rounds the exact binary value.
+static size_t format_precision(double val, int precision, char * buf) noexcept;
+
+size_t format_double(double val, int precision, char * buf) noexcept
+{
+  if (precision != Shortest_Round_Trip)
+    return format_precision(val, precision, buf);
+
+  // 15 significant digits are exact for any decimal of up to 15
+  // digits, so the trailing zeros removed by %g leave the shortest
+  // text when it has at most 15 digits. Subnormals have less
+  // precision and are searched from 1 digit
+  for (precision = fabs(val) < DBL_MIN ? 1 : 15; precision < 17; ++precision)
+    {
+      const size_t n = format_precision(val, precision, buf);
+      double back;
+      if (parse_double(buf, buf + n, back) == buf + n and
+	  (back == val or val != val))
+	return n;
+    }
+  return format_precision(val, 17, buf);
+}
+
+static size_t format_precision(double val, int precision, char * buf) noexcept
+{
+  if (precision <= 0)
+    precision = 1;
+
+  if (precision > 15 or not std::isfinite(val))
+    return slow_format(val, precision, buf);
+
+  const double orig = val;
+  char * p = buf;
+  if (std::signbit(val))
+    {
+      *p++ = '-';
+      val = -val;
+    }
+
+  if (val == 0)
+    {
+      *p++ = '0';
+      *p = '\0';
+      return p - buf;
+    }
+
+  int e = int(floor(ilogb(val)*0.30102999566398119521)); // ~ log10(val)
+  const long double lo = exact_pow10l[precision - 1];
+  const long double hi = exact_pow10l[precision];
+  long double scaled = 0;
+  for (int i = 0; i < 3; ++i)
+    {
+      const int k = precision - 1 - e;
+      if (k > Max_Pow10l or -k > Max_Pow10l)
+	return slow_format(orig, precision, buf);
+      scaled = k >= 0 ? val*exact_pow10l[k] : val/exact_pow10l[-k];
+      if (scaled >= hi)
+	++e;
+      else if (scaled < lo)
+	--e;
+      else
+	break;
+    }
+
+  if (scaled < lo or scaled >= hi)
+    return slow_format(orig, precision, buf);
+
+  const long double floor_scaled = floorl(scaled);
+  const long double frac = scaled - floor_scaled;
+  if (fabsl(frac - 0.5L) <= 2*LDBL_EPSILON*scaled)
+    return slow_format(orig, precision, buf);
+
+  uint64_t digits = uint64_t(floor_scaled) + (frac > 0.5L);
+  if (digits == uint64_t(hi)) // rounded up to 10^precision
+    {
+      digits /= 10;
+      ++e;
+    }
+
+  // %g removes the trailing zeros
+  int num_digits = precision;
+  while (num_digits > 1 and digits % 10 == 0)
+    {
+      digits /= 10;
+      --num_digits;
+    }
+
+  if (e < -4 or e >= precision) // scientific notation
+    {
+      const uint64_t first = digits/uint64_t(exact_pow10l[num_digits - 1]);
+      *p++ = '0' + first;
+      if (num_digits > 1)
+	{
+	  *p++ = '.';
+	  p = write_digits(digits - first*uint64_t(exact_pow10l[num_digits - 1]),
+			   num_digits - 1, p);
+	}
+      *p++ = 'e';
+      *p++ = e < 0 ? '-' : '+';
+      const int abs_e = e < 0 ? -e : e;
+      p = write_digits(abs_e, abs_e >= 100 ? 3 : 2, p);
+    }
+  else if (e < 0) // 0.000ddd
+    {
+      *p++ = '0';
+      *p++ = '.';
+      for (int i = -1; i > e; --i)
+	*p++ = '0';
+      p = write_digits(digits, num_digits, p);
+    }
+  else if (num_digits <= e + 1) // integer: ddd000
+    {
+      p = write_digits(digits, num_digits, p);
+      for (int i = num_digits; i <= e; ++i)
+	*p++ = '0';
+    }
+  else // ddd.ddd
+    {
+      const uint64_t int_part =
+	digits/uint64_t(exact_pow10l[num_digits - 1 - e]);
+      p = write_digits(int_part, e + 1, p);
+      *p++ = '.';
+      p = write_digits(digits - int_part*uint64_t(exact_pow10l[num_digits - 1 - e]),
+		       num_digits - 1 - e, p);
+    }
+
+  *p = '\0';
+  return p - buf;
+}
+
+static size_t slow_fixed(double val, int decimals, char * buf,
+			 size_t size) noexcept
+{
+  const int n = snprintf(buf, size, "%.*f", decimals, val);
+  return n < 0 ? 0 : size_t(n);
+}
+
+// Same scaling technique as format_double(): val*10^decimals is
+// computed in long double with a single rounding and rounded to an
+// integer unless it is too close to a tie
+size_t format_fixed(double val, int decimals, char * buf, size_t size) noexcept
+{
+  if (decimals < 0 or decimals > 15 or size < Max_Double_Length or
+      not std::isfinite(val) or fabs(val) >= 1e15)
+    return slow_fixed(val, decimals, buf, size);
+
+  const long double scaled = fabsl(val*exact_pow10l[decimals]);
+  if (scaled >= 9e18L) // does not fit in uint64_t
+    return slow_fixed(val, decimals, buf, size);
+
+  const long double floor_scaled = floorl(scaled);
+  const long double frac = scaled - floor_scaled;
+  if (fabsl(frac - 0.5L) <= 2*LDBL_EPSILON*scaled)
+    return slow_fixed(val, decimals, buf, size);
+
+  const uint64_t digits = uint64_t(floor_scaled) + (frac > 0.5L);
+  const uint64_t unit = uint64_t(exact_pow10l[decimals]);
+  uint64_t int_part = digits/unit;
+
+  char * p = buf;
+  if (std::signbit(val))
+    *p++ = '-';
+
+  char tmp[20];
+  int len = 0;
+  do
+    tmp[len++] = '0' + int_part % 10;
+  while (int_part /= 10);
+  while (len > 0)
+    *p++ = tmp[--len];
+
+  if (decimals > 0)
+    {
+      *p++ = '.';
+      p = write_digits(digits % unit, decimals, p);
+    }
+
+  *p = '\0';
+  return p - buf;
+}
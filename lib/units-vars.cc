@@ -110,4 +110,40 @@ string units_json()
   return j.dump(2);
 }
 
+string validation_stats_json()
+{
+  json units = json::array();
+  Unit::units().for_each([&units] (const Unit * unit_ptr)
+    {
+      if (unit_ptr->range_violations() == 0 and
+	  unit_ptr->epsilon_passes() == 0)
+	return;
+      json j;
+      j["name"] = unit_ptr->name;
+      j["symbol"] = unit_ptr->symbol;
+      j["physical_quantity"] = unit_ptr->physical_quantity.name;
+      j["range_violations"] = unit_ptr->range_violations();
+      j["epsilon_passes"] = unit_ptr->epsilon_passes();
+      units.push_back(j);
+    });
+
+  json exceptions = json::object();
+  for (const auto & p : ZenExceptionCounts::get())
+    exceptions[p.first] = p.second;
+
+  json j;
+  j["units"] = units;
+  j["exceptions"] = exceptions;
+  return j.dump(2);
+}
+
+void reset_validation_stats()
+{
+  Unit::units().for_each([] (const Unit * unit_ptr)
+			 {
+			   unit_ptr->reset_validation_counters();
+			 });
+  ZenExceptionCounts::reset();
+}
+
 // The following global singleton variables are generated by extract-cv script
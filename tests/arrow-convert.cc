@@ -0,0 +1,85 @@
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <arrow-ipc.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+/* Unit conversion of the columns of an Arrow IPC file
+
+   The unit of a column is read from its `zen.unit` field metadata;
+   each -c option `column:target` converts a float32/float64 column to
+   the target unit and updates its metadata. Columns without
+   conversion are written unchanged.
+*/
+
+CmdLine cmd = { "arrow-convert", ' ', "0" };
+
+ValueArg<string> file = { "f", "file", "input arrow file", true, "",
+			  "input file name", cmd };
+
+ValueArg<string> output = { "o", "output", "output arrow file", false, "",
+			    "output file name", cmd };
+
+MultiArg<string> columns = { "c", "column", "column to convert as "
+			     "column:target-unit", false, "column spec", cmd };
+
+SwitchArg stream = { "s", "stream", "write the stream format instead of "
+		     "the file format", cmd, false };
+
+SwitchArg list_arg = { "l", "list", "list the fields and their units",
+		       cmd, false };
+
+void list_fields(const ArrowTable & table)
+{
+  cout << table.num_rows() << " rows in " << table.batches.size()
+       << " batches" << endl;
+  for (const auto & field : table.fields)
+    {
+      cout << "  " << field.name;
+      const Unit * unit = field.unit();
+      if (unit != nullptr)
+	cout << " [" << unit->symbol << "]";
+      cout << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  ArrowTable table = ArrowTable::read(file.getValue());
+
+  for (const auto & spec : columns.getValue())
+    {
+      const size_t pos = spec.rfind(':');
+      if (pos == string::npos)
+	{
+	  cout << "Invalid column spec " << spec << endl;
+	  abort();
+	}
+      table.convert_column(spec.substr(0, pos),
+			   *search_unit(spec.substr(pos + 1)));
+    }
+
+  if (list_arg.getValue())
+    list_fields(table);
+
+  if (not output.isSet())
+    return 0;
+
+  if (stream.getValue())
+    {
+      const vector<uint8_t> data = table.encode(true);
+      ofstream out(output.getValue(), ios::binary);
+      out.write(reinterpret_cast<const char*>(data.data()), data.size());
+      if (not out.good())
+	{
+	  cout << "Cannot write " << output.getValue() << endl;
+	  abort();
+	}
+    }
+  else
+    table.write(output.getValue());
+}
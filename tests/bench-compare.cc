@@ -0,0 +1,276 @@
+# include <cmath>
+# include <fstream>
+# include <map>
+
+# include <tclap/CmdLine.h>
+# include <json.hpp>
+# include <units-list.H>
+
+using namespace TCLAP;
+using json = nlohmann::json;
+
+/* Comparison of results of bench-conversion
+
+   Reads the JSON documents written by bench-conversion for a baseline
+   and a candidate build (one or more runs of each one) and compares
+   the times of every benchmark id present in both with the
+   Mann-Whitney U test. The null hypothesis is that the candidate times
+   are not greater than the baseline ones. A benchmark is a regression
+   when the test rejects it at the level `alpha` and the median of the
+   candidate is slower than the baseline one by more than `threshold`.
+   The improvements are detected in the same way.
+
+   By default the samples of all the runs of a side are pooled. The
+   samples of a run are not independent of each other (the frequency,
+   the placement and the load of the machine are shared), so on a noisy
+   machine differences between runs of the same build may be reported;
+   with -r the observations are the medians of the runs instead, which
+   takes that variation into account but requires several runs per
+   side (at least 4).
+
+   The p-value is exact when there are no ties and both sides have at
+   most Max_Exact observations; otherwise the normal approximation with
+   tie correction is used. With 5 observations per side the smallest
+   possible p-value is 1/252, so alpha should not be lower than 0.004.
+
+   The exit code is 1 if some benchmark regressed.
+*/
+
+CmdLine cmd = { "bench-compare", ' ', "0" };
+
+MultiArg<string> baseline = { "B", "baseline", "results of a run of the "
+			      "baseline", true, "file name", cmd };
+
+MultiArg<string> candidate = { "C", "candidate", "results of a run of the "
+			       "candidate", true, "file name", cmd };
+
+SwitchArg run_medians = { "r", "run-medians", "compare the medians of the "
+			  "runs instead of the pooled samples", cmd, false };
+
+ValueArg<double> alpha = { "a", "alpha", "significance level", false, 0.01,
+			   "probability", cmd };
+
+ValueArg<double> threshold = { "t", "threshold", "minimum relative change "
+			       "of the medians to report", false, 0.05,
+			       "ratio", cmd };
+
+ValueArg<string> filter = { "b", "benchmark", "only the benchmarks whose id "
+			    "contains this text", false, "", "benchmark id",
+			    cmd };
+
+SwitchArg verbose = { "v", "verbose", "show all the benchmarks", cmd, false };
+
+static constexpr size_t Max_Exact = 20;
+
+double median(vector<double> v)
+{
+  sort(v.begin(), v.end());
+  const size_t n = v.size();
+  return n % 2 == 1 ? v[n/2] : (v[n/2 - 1] + v[n/2])/2;
+}
+
+// Add the observations of the run in file_name to results (id ->
+// observations)
+void read_run(const string & file_name, map<string, vector<double>> & results)
+{
+  ifstream in(file_name);
+  if (not in)
+    {
+      cout << "Cannot open " << file_name << endl;
+      abort();
+    }
+
+  json doc;
+  try
+    {
+      in >> doc;
+    }
+  catch (exception & e)
+    {
+      cout << file_name << " is not a valid JSON document: " << e.what()
+	   << endl;
+      abort();
+    }
+
+  for (const auto & b : doc["benchmarks"])
+    {
+      const auto samples = b["samples"].get<vector<double>>();
+      if (samples.empty())
+	continue;
+      vector<double> & obs = results[b["id"].get<string>()];
+      if (run_medians.getValue())
+	obs.push_back(median(samples));
+      else
+	obs.insert(obs.end(), samples.begin(), samples.end());
+    }
+}
+
+map<string, vector<double>> read_runs(const vector<string> & file_names)
+{
+  map<string, vector<double>> results;
+  for (const auto & name : file_names)
+    read_run(name, results);
+  return results;
+}
+
+/* Return the number of pairs (x, y) with y > x plus half of the ties
+   and set has_ties */
+double u_statistic(const vector<double> & x, const vector<double> & y,
+		   bool & has_ties)
+{
+  double u = 0;
+  has_ties = false;
+  for (auto xi : x)
+    for (auto yj : y)
+      if (yj > xi)
+	u += 1;
+      else if (yj == xi)
+	{
+	  u += 0.5;
+	  has_ties = true;
+	}
+  return u;
+}
+
+// P(U >= u) for samples of sizes n1 and n2 without ties: the number of
+// orderings giving U = k satisfies f(n1, n2, k) = f(n1 - 1, n2, k) +
+// f(n1, n2 - 1, k - n1), where U counts the pairs (x, y) with y > x
+double exact_p_value(size_t n1, size_t n2, double u)
+{
+  const size_t max_u = n1*n2;
+  // f[i][j] holds the counts of (i, j) for all k
+  vector<vector<vector<double>>> f(n1 + 1, vector<vector<double>>(n2 + 1));
+  for (size_t i = 0; i <= n1; ++i)
+    for (size_t j = 0; j <= n2; ++j)
+      {
+	vector<double> & c = f[i][j];
+	c.assign(i*j + 1, 0);
+	if (i == 0 or j == 0)
+	  {
+	    c[0] = 1;
+	    continue;
+	  }
+	for (size_t k = 0; k <= i*j; ++k)
+	  {
+	    if (k <= (i - 1)*j)
+	      c[k] += f[i - 1][j][k];
+	    if (k >= i and k - i <= i*(j - 1))
+	      c[k] += f[i][j - 1][k - i];
+	  }
+      }
+
+  double total = 0, tail = 0;
+  for (size_t k = 0; k <= max_u; ++k)
+    {
+      total += f[n1][n2][k];
+      if (k >= u)
+	tail += f[n1][n2][k];
+    }
+  return tail/total;
+}
+
+// P(U >= u) by the normal approximation with tie and continuity
+// corrections
+double normal_p_value(const vector<double> & x, const vector<double> & y,
+		      double u)
+{
+  const double n1 = x.size(), n2 = y.size(), n = n1 + n2;
+  vector<double> all(x);
+  all.insert(all.end(), y.begin(), y.end());
+  sort(all.begin(), all.end());
+  double ties = 0;
+  for (size_t i = 0, j; i < all.size(); i = j)
+    {
+      for (j = i + 1; j < all.size() and all[j] == all[i]; ++j)
+	;
+      const double t = j - i;
+      ties += t*t*t - t;
+    }
+
+  const double mean = n1*n2/2;
+  const double var = n1*n2/12*((n + 1) - ties/(n*(n - 1)));
+  if (var <= 0)
+    return 1;
+  const double z = (u - mean - 0.5)/sqrt(var);
+  return 0.5*erfc(z/sqrt(2));
+}
+
+// One sided p-value of the hypothesis "y is greater than x"
+double p_value_greater(const vector<double> & x, const vector<double> & y)
+{
+  bool has_ties;
+  const double u = u_statistic(x, y, has_ties);
+  if (not has_ties and x.size() <= Max_Exact and y.size() <= Max_Exact)
+    return exact_p_value(x.size(), y.size(), u);
+  return normal_p_value(x, y, u);
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  const auto base = read_runs(baseline.getValue());
+  const auto cand = read_runs(candidate.getValue());
+
+  DynList<DynList<string>> rows;
+  rows.append(DynList<string>({ "benchmark", "baseline ns", "candidate ns",
+	  "change %", "p-value", "verdict" }));
+  size_t num_compared = 0, num_regressions = 0, num_improvements = 0;
+  for (const auto & b : base)
+    {
+      const string & id = b.first;
+      if (id.find(filter.getValue()) == string::npos)
+	continue;
+
+      auto it = cand.find(id);
+      if (it == cand.end())
+	{
+	  cerr << id << " is not in the candidate" << endl;
+	  continue;
+	}
+
+      const vector<double> & x = b.second, & y = it->second;
+      if (x.size() < 2 or y.size() < 2)
+	{
+	  cerr << id << " has less than two observations" << endl;
+	  continue;
+	}
+
+      ++num_compared;
+      const double mx = median(x), my = median(y);
+      const double change = mx > 0 ? my/mx - 1 : 0;
+      const double p_slower = p_value_greater(x, y);
+      const double p_faster = p_value_greater(y, x);
+      string verdict;
+      double p = p_slower;
+      if (p_slower < alpha.getValue() and change > threshold.getValue())
+	{
+	  verdict = "REGRESSION";
+	  ++num_regressions;
+	}
+      else if (p_faster < alpha.getValue() and -change > threshold.getValue())
+	{
+	  verdict = "improvement";
+	  p = p_faster;
+	  ++num_improvements;
+	}
+      else if (not verbose.getValue())
+	continue;
+
+      rows.append(DynList<string>({ id, fixed_to_string(mx, 2),
+	      fixed_to_string(my, 2), fixed_to_string(100*change, 1),
+	      double_to_string(p, 3), verdict }));
+    }
+
+  for (const auto & c : cand)
+    if (c.first.find(filter.getValue()) != string::npos and
+	base.find(c.first) == base.end())
+      cerr << c.first << " is not in the baseline" << endl;
+
+  if (rows.size() > 1)
+    cout << to_string(format_string(rows)) << endl;
+  cout << num_compared << " benchmarks compared: " << num_regressions
+       << " regressions, " << num_improvements << " improvements" << endl;
+
+  return num_regressions == 0 ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+# include <chrono>
+# include <fstream>
+# include <random>
+
+# include <tclap/CmdLine.h>
+# include <json.hpp>
+# include <units-list.H>
+
+using namespace TCLAP;
+using json = nlohmann::json;
+
+/* Microbenchmarks of the conversion entry points
+
+   Every benchmark executes an operation `iterations` times over a
+   ring of precomputed values inside the range of the source unit and
+   reports the mean time per operation in nanoseconds; this is
+   repeated `samples` times. The dynamic entry points (the ones taking
+   units, names or symbols) are measured for every pair of units of
+   every physical quantity having a registered conversion; the typed
+   ones (`unit_convert<Src, Tgt>` and `Quantity`) can only be
+   instantiated at compile time, so they are measured for a fixed set
+   of representative pairs.
+
+   The output is a JSON document
+
+       { "iterations": n, "benchmarks": [
+           { "id": "symbol_to_symbol/psia/kPa", "name": ...,
+             "physical_quantity": ..., "source": ..., "target": ...,
+             "samples": [ns, ...], "median": ns }, ... ] }
+
+   whose ids are stable between runs, so that two documents can be
+   compared.
+*/
+
+CmdLine cmd = { "bench-conversion", ' ', "0" };
+
+ValueArg<size_t> iterations = { "n", "iterations",
+				"operations per sample", false, 10000,
+				"number of iterations", cmd };
+
+ValueArg<size_t> num_samples = { "s", "samples", "samples per benchmark",
+				 false, 5, "number of samples", cmd };
+
+ValueArg<string> pq_name = { "Q", "physical-quantity",
+			     "only the units of this physical quantity",
+			     false, "", "physical quantity name", cmd };
+
+ValueArg<string> filter = { "b", "benchmark", "only the benchmarks whose "
+			    "name contains this text", false, "",
+			    "benchmark name", cmd };
+
+ValueArg<string> output = { "o", "output", "output file (stdout by default)",
+			    false, "", "file name", cmd };
+
+ValueArg<unsigned long> seed = { "e", "seed", "seed of the values", false, 0,
+				 "seed", cmd };
+
+static constexpr size_t Num_Values = 1024; // size of the ring of values
+
+volatile double sink; // keeps the results alive
+
+json benchmarks = json::array();
+
+// Build the ring of values of unit: inside [min, max] but away from
+// the extremes, so that the converted values are valid in the target
+vector<double> values_of(const Unit & unit)
+{
+  mt19937_64 rng(seed.getValue());
+  const double span = unit.max_val - unit.min_val;
+  uniform_real_distribution<double> dist(unit.min_val + 0.1*span,
+					 unit.max_val - 0.1*span);
+  vector<double> vals(Num_Values);
+  for (auto & v : vals)
+    v = dist(rng);
+  return vals;
+}
+
+/* Time op(val) and add the benchmark to the output. op returns a
+   double that is accumulated so that the compiler cannot drop it */
+template <class Op>
+void bench(const string & name, const Unit & src, const Unit & tgt, Op op)
+{
+  if (name.find(filter.getValue()) == string::npos or
+      (pq_name.isSet() and src.physical_quantity.name != pq_name.getValue()))
+    return;
+
+  const vector<double> vals = values_of(src);
+  const size_t n = iterations.getValue();
+  json samples = json::array();
+  vector<double> times;
+  try
+    {
+      double acc = op(vals[0]); // warm up (and detect invalid pairs)
+      for (size_t s = 0; s < num_samples.getValue(); ++s)
+	{
+	  const auto start = chrono::steady_clock::now();
+	  for (size_t i = 0; i < n; ++i)
+	    acc += op(vals[i % Num_Values]);
+	  const chrono::duration<double, nano> elapsed =
+	    chrono::steady_clock::now() - start;
+	  times.push_back(elapsed.count()/n);
+	  samples.push_back(times.back());
+	}
+      sink = acc;
+    }
+  catch (exception & e)
+    {
+      cerr << name << " " << src.symbol << " -> " << tgt.symbol
+	   << " skipped: " << e.what() << endl;
+      return;
+    }
+
+  sort(times.begin(), times.end());
+  json b;
+  b["id"] = name + "/" + src.symbol + "/" + tgt.symbol;
+  b["name"] = name;
+  b["physical_quantity"] = src.physical_quantity.name;
+  b["source"] = src.symbol;
+  b["target"] = tgt.symbol;
+  b["samples"] = samples;
+  b["median"] = times.empty() ? 0.0 : times[times.size()/2];
+  benchmarks.push_back(b);
+}
+
+void bench_pair(const Unit & src, const Unit & tgt)
+{
+  const auto fct = search_conversion(src, tgt);
+  if (fct == nullptr)
+    return;
+
+  const string & src_name = src.name, & tgt_name = tgt.name;
+  const string & src_symbol = src.symbol, & tgt_symbol = tgt.symbol;
+  const char * src_str = src_symbol.c_str(), * tgt_str = tgt_symbol.c_str();
+
+  bench("function_pointer", src, tgt, [fct] (double v) { return (*fct)(v); });
+
+  bench("search_conversion", src, tgt, [&src, &tgt] (double v)
+	{
+	  return v + (search_conversion(src, tgt) != nullptr);
+	});
+
+  bench("unit_convert_units", src, tgt, [&src, &tgt] (double v)
+	{
+	  return unit_convert(src, v, tgt);
+	});
+
+  bench("name_to_name", src, tgt, [&src_name, &tgt_name] (double v)
+	{
+	  return unit_convert_name_to_name(src_name, v, tgt_name);
+	});
+
+  bench("name_to_symbol", src, tgt, [&src_name, &tgt_symbol] (double v)
+	{
+	  return unit_convert_name_to_symbol(src_name, v, tgt_symbol);
+	});
+
+  bench("symbol_to_name", src, tgt, [&src_symbol, &tgt_name] (double v)
+	{
+	  return unit_convert_symbol_to_name(src_symbol, v, tgt_name);
+	});
+
+  bench("symbol_to_symbol", src, tgt, [&src_symbol, &tgt_symbol] (double v)
+	{
+	  return unit_convert_symbol_to_symbol(src_symbol, v, tgt_symbol);
+	});
+
+  bench("unit_convert_c_str", src, tgt, [src_str, tgt_str] (double v)
+	{
+	  return unit_convert(src_str, tgt_str, v);
+	});
+
+  bench("VtlQuantity_convert", src, tgt, [&src, &tgt] (double v)
+	{
+	  return VtlQuantity(tgt, VtlQuantity(src, v)).raw();
+	});
+}
+
+// Benchmarks of the entry points typed at compile time
+template <class Src, class Tgt> void bench_typed()
+{
+  const Unit & src = Src::get_instance(), & tgt = Tgt::get_instance();
+
+  bench("unit_convert_typed", src, tgt, [] (double v)
+	{
+	  return unit_convert<Src, Tgt>(v);
+	});
+
+  bench("Quantity_construct", src, tgt, [] (double v)
+	{
+	  return Quantity<Src>(v).raw();
+	});
+
+  bench("Quantity_convert", src, tgt, [] (double v)
+	{
+	  return Quantity<Tgt>(Quantity<Src>(v)).raw();
+	});
+
+  // shifts of 1% of the range keep the values of the ring valid
+  const double d = 0.01*(src.max_val - src.min_val);
+
+  bench("Quantity_arithmetic", src, tgt, [d] (double v)
+	{
+	  const Quantity<Src> q(v);
+	  return (d + (-d + q)*1.0).raw();
+	});
+
+  bench("VtlQuantity_construct", src, tgt, [&src] (double v)
+	{
+	  return VtlQuantity(src, v).raw();
+	});
+
+  bench("VtlQuantity_arithmetic", src, tgt, [&src, d] (double v)
+	{
+	  VtlQuantity q(src, v);
+	  q += d;
+	  q -= d;
+	  return q.raw();
+	});
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  bench_typed<psia, kPascal>();
+  bench_typed<Bar, Atmosphere>();
+  bench_typed<Fahrenheit, Celsius>();
+  bench_typed<Kelvin, Rankine>();
+  bench_typed<Gr_cm3, Lb_ft3>();
+
+  PhysicalQuantity::quantities().for_each([] (auto pq)
+    {
+      pq->units().for_each([&pq] (auto src)
+        {
+	  pq->units().for_each([src] (auto tgt) { bench_pair(*src, *tgt); });
+	});
+    });
+
+  json doc;
+  doc["iterations"] = iterations.getValue();
+  doc["benchmarks"] = benchmarks;
+
+  if (output.isSet())
+    {
+      ofstream out(output.getValue());
+      out << doc.dump(2) << endl;
+      if (not out.good())
+	{
+	  cout << "Cannot write " << output.getValue() << endl;
+	  abort();
+	}
+    }
+  else
+    cout << doc.dump(2) << endl;
+}
@@ -0,0 +1,269 @@
+# include <chrono>
+# include <cstdlib>
+# include <fstream>
+# include <new>
+# include <malloc.h>
+
+# include <tclap/CmdLine.h>
+# include <json.hpp>
+# include <units-list.H>
+
+using namespace TCLAP;
+using json = nlohmann::json;
+
+/* Cost of the static initialization of the unit registry
+
+   The library builds its registry (the units, the physical quantities
+   and the conversion tables) in static constructors, before main()
+   is entered. This program measures:
+
+   - the wall time between its first static constructor, which runs
+     before any other one because of its init_priority, and main();
+   - the number of heap allocations and bytes requested in that
+     interval, counted by replacing the global operator new;
+   - the resident set size at main() and its peak;
+   - the heap bytes of each table, measured by building an equivalent
+     table with the same content and counting its live bytes.
+
+   The results are written as a JSON document.
+*/
+
+// Heap accounting; plain counters because the static initialization
+// is single threaded and the program does not create threads
+static size_t num_allocs = 0;
+static size_t allocated_bytes = 0;
+static size_t live_bytes = 0;
+
+// the replaced operator new allocates with malloc()
+# if defined(__GNUC__) && __GNUC__ >= 11
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+# endif
+
+void * operator new (size_t size)
+{
+  void * ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr)
+    throw bad_alloc();
+  ++num_allocs;
+  allocated_bytes += size;
+  live_bytes += malloc_usable_size(ptr);
+  return ptr;
+}
+
+void * operator new[] (size_t size) { return operator new (size); }
+
+void operator delete (void * ptr) noexcept
+{
+  if (ptr == nullptr)
+    return;
+  live_bytes -= malloc_usable_size(ptr);
+  free(ptr);
+}
+
+void operator delete[] (void * ptr) noexcept { operator delete (ptr); }
+
+void operator delete (void * ptr, size_t) noexcept { operator delete (ptr); }
+
+void operator delete[] (void * ptr, size_t) noexcept { operator delete (ptr); }
+
+struct HeapSnapshot
+{
+  size_t allocs = num_allocs;
+  size_t bytes = allocated_bytes;
+  size_t live = live_bytes;
+};
+
+// Taken before any other static constructor of the program
+struct StartMark
+{
+  chrono::steady_clock::time_point time = chrono::steady_clock::now();
+  HeapSnapshot heap;
+};
+
+StartMark start_mark __attribute__((init_priority(101)));
+
+CmdLine cmd = { "bench-startup", ' ', "0" };
+
+ValueArg<string> output = { "o", "output", "output file (stdout by default)",
+			    false, "", "file name", cmd };
+
+// Value in kB of the field name of /proc/self/status (0 if absent)
+size_t proc_status_kb(const string & name)
+{
+  ifstream in("/proc/self/status");
+  string line;
+  while (getline(in, line))
+    if (line.compare(0, name.size() + 1, name + ":") == 0)
+      return strtoul(line.c_str() + name.size() + 1, nullptr, 10);
+  return 0;
+}
+
+static size_t name_pair_hash(const pair<pair<string, string>,
+			     Unit_Convert_Fct_Ptr> & p)
+{
+  return dft_hash_fct(p.first.first) + dft_hash_fct(p.first.second);
+}
+
+static size_t fst_pair_hash(const pair<pair<const Unit*, const Unit*>,
+			    Unit_Convert_Fct_Ptr> & p)
+{
+  return dft_hash_fct(p.first);
+}
+
+static size_t snd_pair_hash(const pair<pair<const Unit*, const Unit*>,
+			    Unit_Convert_Fct_Ptr> & p)
+{
+  return snd_hash_fct(p.first);
+}
+
+json tables = json::array();
+
+/* Add to tables the live heap bytes of the table built by build(),
+   which returns the number of entries */
+template <class Table, class Build>
+void measure_table(const string & name, Build build)
+{
+  const size_t before = live_bytes;
+  Table * tbl = new Table;
+  const size_t entries = build(*tbl);
+  const size_t bytes = live_bytes - before;
+  delete tbl;
+
+  json t;
+  t["table"] = name;
+  t["entries"] = entries;
+  t["heap_bytes"] = bytes;
+  tables.push_back(t);
+}
+
+// Tables with the constructor arguments used by the library
+struct UnitSet : DynSetHash<const Unit *>
+{
+  UnitSet() : DynSetHash<const Unit *>(1000) {}
+};
+
+struct NameTable : UnitHashTbl
+{
+  NameTable() : UnitHashTbl(500, name_pair_hash) {}
+};
+
+struct PairTable : UnitMap
+{
+  PairTable() : UnitMap(2000, fst_pair_hash, snd_pair_hash) {}
+};
+
+// The registered conversions: (source, target, function)
+using Conversion = tuple<const Unit*, const Unit*, Unit_Convert_Fct_Ptr>;
+
+void measure_tables()
+{
+  vector<Conversion> conversions;
+  Unit::units().for_each([&conversions] (const Unit * src)
+    {
+      src->family_units().for_each([&conversions, src] (const Unit * tgt)
+        {
+	  auto fct = search_conversion(*src, *tgt);
+	  if (fct != nullptr)
+	    conversions.emplace_back(src, tgt, fct);
+	});
+    });
+
+  measure_table<UnitSet>("Unit::unit_tbl", [] (UnitSet & tbl)
+    {
+      Unit::units().for_each([&tbl] (const Unit * u) { tbl.insert(u); });
+      return tbl.size();
+    });
+
+  measure_table<UnitItemTable>("Unit::tbl", [] (UnitItemTable & tbl)
+    {
+      Unit::units().for_each([&tbl] (const Unit * u)
+			     {
+			       tbl.register_item(u);
+			     });
+      return tbl.items().size();
+    });
+
+  measure_table<UnitItemTable>("PhysicalQuantity::tbl",
+			       [] (UnitItemTable & tbl)
+    {
+      PhysicalQuantity::quantities().for_each([&tbl] (auto pq)
+					      {
+						tbl.register_item(pq);
+					      });
+      return tbl.items().size();
+    });
+
+  measure_table<PairTable>("__unit_map", [&conversions] (PairTable & tbl)
+    {
+      for (const auto & c : conversions)
+	tbl.insert(make_pair(make_pair(get<0>(c), get<1>(c)), get<2>(c)));
+      return tbl.size();
+    });
+
+  using Key = function<pair<string, string>(const Unit*, const Unit*)>;
+  const vector<pair<string, Key>> string_tables =
+    { { "__unit_name_name_tbl", [] (const Unit * s, const Unit * t)
+	{ return make_pair(s->name, t->name); } },
+      { "__unit_name_symbol_tbl", [] (const Unit * s, const Unit * t)
+	{ return make_pair(s->name, t->symbol); } },
+      { "__unit_symbol_name_tbl", [] (const Unit * s, const Unit * t)
+	{ return make_pair(s->symbol, t->name); } },
+      { "__unit_symbol_symbol_tbl", [] (const Unit * s, const Unit * t)
+	{ return make_pair(s->symbol, t->symbol); } } };
+  for (const auto & st : string_tables)
+    measure_table<NameTable>(st.first, [&conversions, &st] (NameTable & tbl)
+      {
+	for (const auto & c : conversions)
+	  tbl.insert(st.second(get<0>(c), get<1>(c)), get<2>(c));
+	return tbl.size();
+      });
+
+  measure_table<CompoundUnitTbl>("__compound_unit_tbl",
+				 [] (CompoundUnitTbl & tbl)
+    {
+      size_t n = 0;
+      __compound_unit_tbl.items().for_each([&tbl, &n] (const auto & item)
+	{
+	  n += tbl.insert(item.first, *Unit::search_by_name(item.second));
+	});
+      return n;
+    });
+}
+
+int main(int argc, char *argv[])
+{
+  const auto main_time = chrono::steady_clock::now();
+  const HeapSnapshot main_heap;
+  const size_t rss_kb = proc_status_kb("VmRSS");
+
+  cmd.parse(argc, argv);
+
+  const chrono::duration<double, micro> init_time =
+    main_time - start_mark.time;
+
+  json doc;
+  doc["static_init_us"] = init_time.count();
+  doc["static_init_allocations"] = main_heap.allocs - start_mark.heap.allocs;
+  doc["static_init_bytes"] = main_heap.bytes - start_mark.heap.bytes;
+  doc["live_heap_bytes_at_main"] = main_heap.live;
+  doc["rss_kb_at_main"] = rss_kb;
+  doc["num_units"] = Unit::size();
+  doc["num_physical_quantities"] = PhysicalQuantity::quantities().size();
+
+  measure_tables();
+  doc["tables"] = tables;
+  doc["peak_rss_kb"] = proc_status_kb("VmHWM");
+
+  if (output.isSet())
+    {
+      ofstream out(output.getValue());
+      out << doc.dump(2) << endl;
+      if (not out.good())
+	{
+	  cout << "Cannot write " << output.getValue() << endl;
+	  abort();
+	}
+    }
+  else
+    cout << doc.dump(2) << endl;
+}
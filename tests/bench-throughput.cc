@@ -0,0 +1,204 @@
+# include <chrono>
+# include <random>
+# include <thread>
+# include <unistd.h>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <batch-kernels.H>
+# include <conversion-plan.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+/* Throughput of the batch conversion across the memory hierarchy
+
+   Converts arrays of doubles (out of place) whose working set (input
+   plus output) is half of the L1, L2 and L3 data caches and four times
+   the L3 (main memory); the sizes are read from the system or given
+   with -z. For every pair, variant, size and number of threads it
+   reports the converted values per second and the memory traffic in
+   GB/s, counting 16 bytes (a read and a write) per value.
+
+   The affine pairs are converted with every batch kernel supported by
+   the cpu; the nonlinear ones, for which the kernels do not apply,
+   with the exact conversion function and with a lookup table covering
+   the unit range. Comparing the GB/s of the sizes tells whether a
+   variant is bound by computation (flat) or by the memory bandwidth
+   (falling with the size).
+*/
+
+CmdLine cmd = { "bench-throughput", ' ', "0" };
+
+MultiArg<string> pairs = { "c", "conversion", "additional pair to measure as "
+			   "source-symbol:target-symbol", false,
+			   "conversion spec", cmd };
+
+MultiArg<size_t> sizes = { "z", "size", "working set size in bytes "
+			   "(default: the cache sizes)", false, "bytes", cmd };
+
+MultiArg<size_t> thread_counts = { "t", "threads", "number of threads "
+				   "(default: 1 and the hardware threads)",
+				   false, "number of threads", cmd };
+
+ValueArg<double> min_time = { "m", "min-time", "minimum seconds of a "
+			      "measurement", false, 0.2, "seconds", cmd };
+
+ValueArg<size_t> num_knots = { "k", "knots", "knots of the lookup tables",
+			       false, 4096, "number of knots", cmd };
+
+// Working sets of the default sizes
+vector<size_t> cache_sizes()
+{
+  auto cache = [] (int name, long dflt)
+    {
+      const long size = sysconf(name);
+      return size_t(size > 0 ? size : dflt);
+    };
+  const size_t l3 = cache(_SC_LEVEL3_CACHE_SIZE, 32 << 20);
+  return { cache(_SC_LEVEL1_DCACHE_SIZE, 32 << 10)/2,
+	   cache(_SC_LEVEL2_CACHE_SIZE, 1 << 20)/2, l3/2,
+	   max<size_t>(4*l3, 256 << 20) };
+}
+
+// A way of converting an array: [in, in + n) -> out
+using Variant = pair<string, function<void(const double*, double*, size_t)>>;
+
+/* Return the seconds per repetition of the conversion of in to out
+   with num_threads threads, each one converting a contiguous slice
+   of the arrays */
+double measure(const Variant & variant, const vector<double> & in,
+	       vector<double> & out, size_t num_threads)
+{
+  const size_t n = in.size();
+  auto run = [&] (size_t reps)
+    {
+      auto work = [&] (size_t begin, size_t end)
+	{
+	  for (size_t r = 0; r < reps; ++r)
+	    variant.second(in.data() + begin, out.data() + begin, end - begin);
+	};
+
+      const auto start = chrono::steady_clock::now();
+      vector<thread> threads;
+      const size_t slice = (n + num_threads - 1)/num_threads;
+      for (size_t i = 1; i < num_threads; ++i)
+	threads.emplace_back(work, min(i*slice, n), min((i + 1)*slice, n));
+      work(0, min(slice, n));
+      for (auto & t : threads)
+	t.join();
+      const chrono::duration<double> elapsed =
+	chrono::steady_clock::now() - start;
+      return elapsed.count();
+    };
+
+  run(1); // warm up the caches and the pages
+  size_t reps = 1;
+  double elapsed;
+  while ((elapsed = run(reps)) < min_time.getValue())
+    reps = elapsed <= 0 ? 2*reps :
+      max(2*reps, size_t(reps*1.2*min_time.getValue()/elapsed));
+  return elapsed/reps;
+}
+
+vector<Variant> variants_of(ConversionPlan & plan)
+{
+  vector<Variant> variants;
+  if (plan.is_affine())
+    {
+      const double a = plan.slope(), b = plan.offset();
+      for (auto kernel : { BatchKernel::Scalar, BatchKernel::SSE,
+	    BatchKernel::AVX2, BatchKernel::AVX512 })
+	if (batch_kernel_supported(kernel))
+	  variants.emplace_back(batch_kernel_name(kernel),
+				[kernel, a, b] (const double * in, double * out,
+						size_t n)
+				{
+				  affine_batch(kernel, in, out, n, a, b);
+				});
+      return variants;
+    }
+
+  const auto fct = plan.function();
+  variants.emplace_back("function", [fct] (const double * in, double * out,
+					   size_t n)
+			{
+			  for (size_t i = 0; i < n; ++i)
+			    out[i] = (*fct)(in[i]);
+			});
+
+  const Unit & src = plan.source_unit();
+  plan.use_table(src.min_val, src.max_val, num_knots.getValue());
+  variants.emplace_back("table", [&plan] (const double * in, double * out,
+					  size_t n)
+			{
+			  plan(in, out, n);
+			});
+  return variants;
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  vector<pair<const Unit*, const Unit*>> units =
+    { { &psia::get_instance(), &kPascal::get_instance() },
+      { &Fahrenheit::get_instance(), &Kelvin::get_instance() },
+      { &Sgw_sg::get_instance(), &Molality_NaCl::get_instance() },
+      { &CentiStoke::get_instance(),
+	&SayboltUniversalViscosisty::get_instance() } };
+  for (const auto & spec : pairs.getValue())
+    {
+      const size_t pos = spec.rfind(':');
+      if (pos == string::npos)
+	{
+	  cout << "Invalid conversion spec " << spec << endl;
+	  abort();
+	}
+      units.emplace_back(search_unit(spec.substr(0, pos)),
+			 search_unit(spec.substr(pos + 1)));
+    }
+
+  const vector<size_t> working_sets =
+    sizes.isSet() ? sizes.getValue() : cache_sizes();
+  vector<size_t> threads = thread_counts.getValue();
+  if (threads.empty())
+    {
+      threads.push_back(1);
+      if (thread::hardware_concurrency() > 1)
+	threads.push_back(thread::hardware_concurrency());
+    }
+
+  DynList<DynList<string>> rows;
+  rows.append(DynList<string>({ "conversion", "variant", "bytes", "threads",
+	  "Mvalues/s", "GB/s" }));
+  for (const auto & p : units)
+    {
+      ConversionPlan plan(*p.first, *p.second);
+      const string name = p.first->symbol + "->" + p.second->symbol;
+      for (const auto & variant : variants_of(plan))
+	for (auto bytes : working_sets)
+	  {
+	    const size_t n = max<size_t>(bytes/(2*sizeof(double)), 1);
+	    vector<double> in(n), out(n);
+	    mt19937_64 rng(n);
+	    uniform_real_distribution<double> dist(p.first->min_val,
+						   p.first->max_val);
+	    for (auto & v : in)
+	      v = dist(rng);
+
+	    for (auto num_threads : threads)
+	      {
+		const double secs = measure(variant, in, out,
+					    max<size_t>(num_threads, 1));
+		rows.append(DynList<string>({ name, variant.first,
+			to_string(2*sizeof(double)*n), to_string(num_threads),
+			fixed_to_string(n/secs/1e6, 1),
+			fixed_to_string(2*sizeof(double)*n/secs/1e9, 2) }));
+	      }
+	  }
+    }
+
+  cout << to_string(format_string(rows)) << endl;
+}
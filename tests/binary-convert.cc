@@ -0,0 +1,52 @@
+# include <chrono>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <binary-conversion.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+CmdLine cmd = { "binary-convert", ' ', "0" };
+
+ValueArg<string> file = { "f", "file",
+			  "file of raw little-endian values converted in place",
+			  true, "", "file name", cmd };
+
+ValueArg<string> source = {"S", "source-unit", "source unit", true,
+			   "", "source unit", cmd};
+ValueArg<string> target = {"T", "target-unit", "target unit", true,
+			   "", "target unit", cmd};
+
+SwitchArg single = { "F", "float", "values are float instead of double",
+		     cmd, false };
+
+ValueArg<size_t> threads = { "t", "threads",
+			     "number of threads (0 for all the hardware threads)",
+			     false, 0, "number of threads", cmd };
+
+SwitchArg verbose = { "v", "verbose", "print the conversion throughput",
+		      cmd, false };
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  ConversionPlan plan(*search_unit(source.getValue()),
+		      *search_unit(target.getValue()));
+
+  const auto start = chrono::steady_clock::now();
+  const size_t n = single.getValue() ?
+    convert_file_inplace<float>(plan, file.getValue(), threads.getValue()) :
+    convert_file_inplace<double>(plan, file.getValue(), threads.getValue());
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  if (verbose.getValue())
+    {
+      const double bytes = n*(single.getValue() ? sizeof(float) :
+			      sizeof(double));
+      cout << n << " values converted in " << elapsed.count() << " s ("
+	   << bytes/elapsed.count()/1e9 << " GB/s)" << endl;
+    }
+}
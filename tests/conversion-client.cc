@@ -0,0 +1,154 @@
+# include <chrono>
+# include <random>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <conversion-protocol.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+/* Test client of conversion-daemon
+
+   With values in the command line, converts them through the daemon
+   and prints the results. Otherwise, it loads the daemon from several
+   concurrent connections, each one sending requests of random values
+   inside the range of the source unit, verifies every reply against
+   the local conversion and prints the throughput.
+
+   The unit ids are resolved through the daemon, as a client without
+   the library would do. An error replied by the daemon (unknown unit
+   or conversion, value out of range) is printed and the exit code is
+   1.
+*/
+
+CmdLine cmd = { "conversion-client", ' ', "0" };
+
+ValueArg<string> socket_path = { "s", "socket", "path of the daemon socket",
+				 false, "/tmp/zen-conversion.sock",
+				 "socket path", cmd };
+
+ValueArg<string> source = {"S", "source-unit", "source unit", true,
+			   "", "source unit", cmd};
+ValueArg<string> target = {"T", "target-unit", "target unit", true,
+			   "", "target unit", cmd};
+
+ValueArg<size_t> num_connections = { "c", "connections",
+				     "number of concurrent connections",
+				     false, 4, "number of connections", cmd };
+
+ValueArg<size_t> num_requests = { "r", "requests",
+				  "number of requests per connection",
+				  false, 1000, "number of requests", cmd };
+
+ValueArg<size_t> num_values = { "n", "num-values",
+				"number of values per request", false, 1000,
+				"number of values", cmd };
+
+ValueArg<unsigned long> seed = { "e", "seed", "seed of the random values",
+				 false, 0, "seed", cmd };
+
+UnlabeledMultiArg<double> vals = { "values", "list of values to convert",
+				   false, "list of values to convert", cmd };
+
+// Send the requests of a connection; return the number of wrong values
+size_t load(size_t conn)
+{
+  ConversionClient client(socket_path.getValue());
+  const uint32_t src_id = client.unit_id(source.getValue());
+  const uint32_t tgt_id = client.unit_id(target.getValue());
+
+  const Unit & src_unit = *search_unit(source.getValue());
+  const ConversionPlan plan(src_unit, *search_unit(target.getValue()));
+
+  mt19937_64 rng(seed.getValue() + conn);
+  uniform_real_distribution<double> dist(src_unit.min_val, src_unit.max_val);
+  const size_t n = num_values.getValue();
+  vector<double> in(n), out(n), expected(n);
+  size_t num_wrong = 0;
+  for (size_t r = 0; r < num_requests.getValue(); ++r)
+    {
+      for (auto & v : in)
+	v = dist(rng);
+      client.convert(src_id, tgt_id, in.data(), out.data(), n);
+      plan(in.data(), expected.data(), n);
+      for (size_t i = 0; i < n; ++i)
+	num_wrong += out[i] != expected[i];
+    }
+  return num_wrong;
+}
+
+// Convert the values of the command line and print the results
+void convert_values()
+{
+  ConversionClient client(socket_path.getValue());
+  const uint32_t src_id = client.unit_id(source.getValue());
+  const uint32_t tgt_id = client.unit_id(target.getValue());
+  const vector<double> & in = vals.getValue();
+  vector<double> out(in.size());
+  client.convert(src_id, tgt_id, in.data(), out.data(), in.size());
+  for (auto v : out)
+    cout << double_to_string(v) << " ";
+  cout << endl;
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  if (vals.isSet())
+    try
+      {
+	convert_values();
+	return 0;
+      }
+    catch (ZenException & e) // error replied by the daemon
+      {
+	cout << e.type << ": " << e.msg << endl;
+	return 1;
+      }
+
+  const size_t num_conn = max<size_t>(num_connections.getValue(), 1);
+  vector<size_t> wrong(num_conn);
+  vector<string> errors(num_conn); // error of a connection or empty
+  vector<thread> threads;
+  const auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < num_conn; ++i)
+    threads.emplace_back([i, &wrong, &errors]
+			 {
+			   try
+			     {
+			       wrong[i] = load(i);
+			     }
+			   catch (ZenException & e)
+			     {
+			       errors[i] = e.type + ": " + e.msg;
+			     }
+			 });
+  for (auto & t : threads)
+    t.join();
+  const chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+  size_t num_failed = 0;
+  for (size_t i = 0; i < num_conn; ++i)
+    if (not errors[i].empty())
+      {
+	cout << "Connection " << i << ": " << errors[i] << endl;
+	++num_failed;
+      }
+  if (num_failed > 0)
+    return 1;
+
+  const double num_req = double(num_conn)*num_requests.getValue();
+  size_t num_wrong = 0;
+  for (auto w : wrong)
+    num_wrong += w;
+  cout << num_req << " requests in " << elapsed.count() << " s ("
+       << num_req/elapsed.count() << " requests/s, "
+       << num_req*num_values.getValue()/elapsed.count()/1e6
+       << " million values/s)" << endl
+       << num_wrong << " wrong values" << endl;
+
+  return num_wrong == 0 ? 0 : 1;
+}
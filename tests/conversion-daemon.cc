@@ -0,0 +1,421 @@
+# include <csignal>
+# include <fcntl.h>
+# include <poll.h>
+# include <deque>
+# include <map>
+# include <memory>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <quantity-array.H>
+# include <conversion-protocol.H>
+
+using namespace TCLAP;
+
+/* Local conversion daemon
+
+   Serves the protocol of conversion-protocol.H on a Unix domain
+   socket so that processes which cannot link the library may convert
+   arrays of values.
+
+   Every connection has a thread that reads its requests; a request
+   is queued and its connection waits for the reply before reading the
+   next one. A pool of workers takes all the queued requests at once
+   (up to a bound of values), groups them by pair of units and
+   converts every group with a single call to the batch interface of
+   the plan: the values of the requests of a group are gathered in a
+   scratch array and each reply is written with `writev()` directly
+   from its slice of that array.
+
+   A request of more than max-request values is answered with
+   Reply_Bad_Request and closes its connection, which bounds the
+   memory taken by a connection. SIGINT and SIGTERM stop the daemon
+   and remove its socket; they are blocked in every thread and only
+   received by the main thread while it waits for connections.
+*/
+
+CmdLine cmd = { "conversion-daemon", ' ', "0" };
+
+ValueArg<string> socket_path = { "s", "socket", "path of the socket", false,
+				 "/tmp/zen-conversion.sock", "socket path",
+				 cmd };
+
+ValueArg<size_t> num_workers = { "t", "threads", "number of worker threads "
+				 "(0 for all the hardware threads)", false, 0,
+				 "number of threads", cmd };
+
+ValueArg<size_t> max_batch = { "b", "batch", "maximum number of values "
+			       "converted by a worker at once", false,
+			       1 << 20, "number of values", cmd };
+
+ValueArg<uint64_t> max_request = { "m", "max-request", "maximum number of "
+				   "values of a request", false, 1 << 17,
+				   "number of values", cmd };
+
+SwitchArg verbose = { "v", "verbose", "print the size of the batches",
+		      cmd, false };
+
+vector<const Unit *> units_by_id;
+
+// A conversion request waiting for its reply
+struct Job
+{
+  int fd = -1;
+  ConversionRequest req;
+  vector<double> vals;
+  bool done = false;
+};
+
+class JobQueue
+{
+  mutex m;
+  condition_variable pending_cond, done_cond;
+  deque<Job*> pending;
+
+public:
+
+  // Queue job and wait until it has been answered
+  void process(Job & job)
+  {
+    unique_lock<mutex> lock(m);
+    job.done = false;
+    pending.push_back(&job);
+    pending_cond.notify_one();
+    done_cond.wait(lock, [&job] { return job.done; });
+  }
+
+  // Take the queued jobs up to max_vals values (at least one job)
+  void take(vector<Job*> & jobs, size_t max_vals)
+  {
+    jobs.clear();
+    unique_lock<mutex> lock(m);
+    pending_cond.wait(lock, [this] { return not pending.empty(); });
+    size_t n = 0;
+    while (not pending.empty() and
+	   (jobs.empty() or n + pending.front()->vals.size() <= max_vals))
+      {
+	n += pending.front()->vals.size();
+	jobs.push_back(pending.front());
+	pending.pop_front();
+      }
+  }
+
+  void complete(const vector<Job*> & jobs)
+  {
+    lock_guard<mutex> lock(m);
+    for (auto job : jobs)
+      job->done = true;
+    done_cond.notify_all();
+  }
+};
+
+JobQueue job_queue;
+
+// Return the message of e without the category, file, line and type
+// fields that precede it in what()
+string message_of(const ZenException & e)
+{
+  const char * msg = e.what();
+  for (int i = 0; i < 4 and strchr(msg, '|') != nullptr; ++i)
+    msg = strchr(msg, '|') + 1;
+  return msg;
+}
+
+// Send a reply of status with the message msg; a failed write is
+// ignored because the reader of the connection will notice it
+void send_error(int fd, ReplyStatus status, const string & msg)
+{
+  ConversionReply reply;
+  reply.status = status;
+  reply.count = msg.size();
+  struct iovec iov[2] = { { &reply, sizeof(reply) },
+			  { const_cast<char*>(msg.data()), msg.size() } };
+  try
+    {
+      writev_fully(fd, iov, 2);
+    }
+  catch (IOError &) {}
+}
+
+void send_values(int fd, double * vals, size_t n)
+{
+  ConversionReply reply;
+  reply.count = n;
+  struct iovec iov[2] = { { &reply, sizeof(reply) },
+			  { vals, n*sizeof(double) } };
+  try
+    {
+      writev_fully(fd, iov, 2);
+    }
+  catch (IOError &) {}
+}
+
+class Worker
+{
+  map<pair<uint32_t, uint32_t>, unique_ptr<ConversionPlan>> plans;
+  vector<double> scratch;
+  vector<Job*> jobs;
+  vector<Job*> valid; // jobs of a group whose values are in range
+
+  // Return the plan of the pair of job or nullptr if there is none;
+  // in that case status and msg describe the error
+  const ConversionPlan * plan_of(const Job & job, ReplyStatus & status,
+				 string & msg)
+  {
+    const uint32_t src = job.req.src_id, tgt = job.req.tgt_id;
+    auto it = plans.find(make_pair(src, tgt));
+    if (it != plans.end())
+      return it->second.get();
+
+    if (src >= units_by_id.size() or tgt >= units_by_id.size())
+      {
+	ostringstream s;
+	s << "unit id " << max(src, tgt) << " does not exist";
+	status = Reply_Unit_Not_Found;
+	msg = s.str();
+	return nullptr;
+      }
+
+    try
+      {
+	auto plan = make_unique<ConversionPlan>(*units_by_id[src],
+						*units_by_id[tgt]);
+	return (plans[make_pair(src, tgt)] = move(plan)).get();
+      }
+    catch (UnitConversionNotFound & e)
+      {
+	status = Reply_Conversion_Not_Found;
+	msg = message_of(e);
+	return nullptr;
+      }
+  }
+
+  // Convert the jobs of [begin, end), all of them for the same pair
+  void convert_group(Job ** begin, Job ** end)
+  {
+    ReplyStatus status = Reply_Ok;
+    string msg;
+    const ConversionPlan * plan = plan_of(**begin, status, msg);
+    if (plan == nullptr)
+      {
+	for (auto p = begin; p < end; ++p)
+	  send_error((*p)->fd, status, msg);
+	return;
+      }
+
+    valid.clear();
+    size_t n = 0;
+    for (auto p = begin; p < end; ++p)
+      try
+	{
+	  check_values(plan->source_unit(), (*p)->vals.data(),
+		       (*p)->vals.size());
+	  n += (*p)->vals.size();
+	  valid.push_back(*p);
+	}
+      catch (OutOfUnitRange & e)
+	{
+	  send_error((*p)->fd, Reply_Out_Of_Range, message_of(e));
+	}
+
+    if (valid.size() == 1)
+      {
+	vector<double> & vals = valid[0]->vals;
+	(*plan)(vals.data(), vals.data(), vals.size());
+	send_values(valid[0]->fd, vals.data(), vals.size());
+	return;
+      }
+
+    scratch.resize(n);
+    double * ptr = scratch.data();
+    for (auto job : valid)
+      ptr = copy(job->vals.begin(), job->vals.end(), ptr);
+
+    (*plan)(scratch.data(), scratch.data(), n);
+
+    ptr = scratch.data();
+    for (auto job : valid)
+      {
+	send_values(job->fd, ptr, job->vals.size());
+	ptr += job->vals.size();
+      }
+  }
+
+public:
+
+  void run()
+  {
+    while (true)
+      {
+	job_queue.take(jobs, max_batch.getValue());
+	sort(jobs.begin(), jobs.end(), [] (const Job * j1, const Job * j2)
+	     {
+	       return make_pair(j1->req.src_id, j1->req.tgt_id) <
+		 make_pair(j2->req.src_id, j2->req.tgt_id);
+	     });
+
+	if (verbose.getValue())
+	  {
+	    size_t n = 0;
+	    for (auto job : jobs)
+	      n += job->vals.size();
+	    cout << "batch of " << jobs.size() << " requests, " << n
+		 << " values" << endl;
+	  }
+
+	for (size_t i = 0, j; i < jobs.size(); i = j)
+	  {
+	    for (j = i + 1; j < jobs.size() and
+		   jobs[j]->req.src_id == jobs[i]->req.src_id and
+		   jobs[j]->req.tgt_id == jobs[i]->req.tgt_id; ++j)
+	      ;
+	    convert_group(jobs.data() + i, jobs.data() + j);
+	  }
+
+	job_queue.complete(jobs);
+      }
+  }
+};
+
+void lookup_unit(int fd, uint64_t len)
+{
+  string name(len, '\0');
+  read_fully(fd, &name[0], len);
+  auto unit_ptr = Unit::search(name);
+  if (unit_ptr == nullptr)
+    {
+      send_error(fd, Reply_Unit_Not_Found, "unit " + name + " not found");
+      return;
+    }
+
+  ConversionReply reply;
+  reply.unit_id = unit_ptr->get_id();
+  write_fully(fd, reinterpret_cast<const char*>(&reply), sizeof(reply));
+}
+
+void serve_connection(int fd)
+{
+  Job job;
+  job.fd = fd;
+  try
+    {
+      while (read_fully(fd, &job.req, sizeof(job.req)))
+	{
+	  if (job.req.count > max_request.getValue())
+	    {
+	      ostringstream s;
+	      s << "request of " << job.req.count << " values exceeds the "
+		<< "maximum of " << max_request.getValue();
+	      send_error(fd, Reply_Bad_Request, s.str());
+	      break;
+	    }
+
+	  if (job.req.src_id == Unit_Lookup)
+	    {
+	      lookup_unit(fd, job.req.count);
+	      continue;
+	    }
+
+	  job.vals.resize(job.req.count);
+	  read_fully(fd, job.vals.data(), job.vals.size()*sizeof(double));
+	  job_queue.process(job);
+	}
+    }
+  catch (IOError &) {} // the client went away
+
+  close(fd);
+}
+
+volatile sig_atomic_t stop = 0;
+
+void request_stop(int) { stop = 1; }
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  if (max_request.getValue() == 0 or
+      max_request.getValue() > Max_Request_Count)
+    {
+      cout << "Maximum request must be in [1, " << Max_Request_Count << "]"
+	   << endl;
+      abort();
+    }
+
+  units_by_id.resize(Unit::size());
+  Unit::units().for_each([] (const Unit * ptr)
+			 {
+			   units_by_id[ptr->get_id()] = ptr;
+			 });
+
+  const sockaddr_un addr = unix_socket_address(socket_path.getValue());
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.getValue().c_str());
+  if (listen_fd < 0 or
+      ::bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr),
+	     sizeof(addr)) < 0 or
+      listen(listen_fd, SOMAXCONN) < 0)
+    {
+      cout << "Cannot listen on " << socket_path.getValue() << ": "
+	   << strerror(errno) << endl;
+      abort();
+    }
+
+  struct sigaction act = {};
+  act.sa_handler = request_stop;
+  sigemptyset(&act.sa_mask);
+  sigaction(SIGINT, &act, nullptr);
+  sigaction(SIGTERM, &act, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  // the threads inherit the blocked signals; the main thread unblocks
+  // them only inside ppoll(), so a signal cannot be lost between the
+  // test of stop and the wait
+  sigset_t stop_signals, wait_mask;
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signals, &wait_mask);
+  sigdelset(&wait_mask, SIGINT);
+  sigdelset(&wait_mask, SIGTERM);
+
+  size_t n = num_workers.getValue();
+  if (n == 0)
+    n = max(1u, thread::hardware_concurrency());
+  for (size_t i = 0; i < n; ++i)
+    thread([] { Worker().run(); }).detach();
+
+  // not blocking: a pending connection may be gone when accepted
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+  while (not stop)
+    {
+      struct pollfd pfd = { listen_fd, POLLIN, 0 };
+      if (ppoll(&pfd, 1, nullptr, &wait_mask) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  cout << "poll failed: " << strerror(errno) << endl;
+	  unlink(socket_path.getValue().c_str());
+	  abort();
+	}
+
+      const int fd = accept(listen_fd, nullptr, nullptr);
+      if (fd < 0)
+	{
+	  if (errno == EAGAIN or errno == EWOULDBLOCK or errno == EINTR or
+	      errno == ECONNABORTED)
+	    continue;
+	  cout << "accept failed: " << strerror(errno) << endl;
+	  unlink(socket_path.getValue().c_str());
+	  abort();
+	}
+      thread(serve_connection, fd).detach();
+    }
+
+  close(listen_fd);
+  unlink(socket_path.getValue().c_str());
+
+  // the detached threads may still be blocked on the queue, whose
+  // destruction by exit() would be undefined
+  _exit(0);
+}
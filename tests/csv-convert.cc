@@ -0,0 +1,418 @@
+# include <fcntl.h>
+# include <unistd.h>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <conversion-stream.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+/* Conversion of the columns of a csv file
+
+   The columns to convert are given with -c as `column:source:target`
+   or, when the header annotates the unit of the column as in
+   `pressure[psig]`, as `column:target`. The column is named by its
+   header field, by the name preceding the annotation or by its
+   position (starting from 0).
+
+   The file is processed in blocks of complete records, so that the
+   memory does not depend on its size. In every block the values of
+   each converted column are gathered and converted in a single batch;
+   then the block is written back replacing only the converted fields,
+   the rest of the text (other fields, quotes, line ends) is copied
+   byte for byte; in a quoted field only the number between the quotes
+   is replaced. Empty fields are left empty. The header annotation
+   of a converted column is rewritten with the target unit as given
+   in -c. The converted values are written with the shortest text that
+   is read back as the same double; -P rounds them to fewer digits.
+
+   A field that is not a number stops the conversion: the records
+   before it are written, the error is reported with its line number
+   and the exit code is 1.
+*/
+
+CmdLine cmd = { "csv-convert", ' ', "0" };
+
+ValueArg<string> file = { "f", "file", "input csv file (stdin by default)",
+			  false, "", "input file name", cmd };
+
+ValueArg<string> output = { "o", "output", "output file (stdout by default)",
+			    false, "", "output file name", cmd };
+
+MultiArg<string> columns =
+  { "c", "column", "column to convert: column:source:target or column:target "
+    "for columns annotated with its unit", true, "column spec", cmd };
+
+ValueArg<int> precision = { "P", "precision", "significant digits of the "
+			    "converted values (default: the shortest text "
+			    "read back as the same double)", false,
+			    Shortest_Round_Trip, "precision", cmd };
+
+ValueArg<size_t> block_size = { "b", "block-size", "size of read blocks",
+				false, 1 << 20, "block size", cmd };
+
+struct Field
+{
+  const char * begin;
+  const char * end;
+};
+
+// Return the end of the record starting at p or nullptr if the record
+// is not complete in [p, end). The fields are appended to fields. If
+// at_eof, a record not ended by a newline ends at end
+const char * scan_record(const char * p, const char * end,
+			 vector<Field> & fields, bool at_eof = false)
+{
+  bool quoted = false;
+  const char * field_begin = p;
+  for (; p < end; ++p)
+    if (*p == '"')
+      quoted = not quoted;
+    else if (quoted)
+      continue;
+    else if (*p == ',')
+      {
+	fields.push_back({field_begin, p});
+	field_begin = p + 1;
+      }
+    else if (*p == '\n')
+      {
+	const char * field_end = p > field_begin and p[-1] == '\r' ? p - 1 : p;
+	fields.push_back({field_begin, field_end});
+	return p + 1;
+      }
+
+  if (not at_eof)
+    return nullptr;
+  fields.push_back({field_begin, end});
+  return end;
+}
+
+// Contents of a field without the surrounding blanks and quotes
+Field unquote(Field f)
+{
+  while (f.begin < f.end and is_blank(*f.begin))
+    ++f.begin;
+  while (f.end > f.begin and is_blank(f.end[-1]))
+    --f.end;
+  if (f.end - f.begin >= 2 and *f.begin == '"' and f.end[-1] == '"')
+    return {f.begin + 1, f.end - 1};
+  return f;
+}
+
+struct Column
+{
+  size_t index;
+  ConversionPlan plan;
+  string header; // rewritten header field
+  vector<double> vals;
+};
+
+// Build the columns to convert from the header fields and the -c specs,
+// sorted by position in the record
+vector<Column> resolve_columns(const vector<Field> & header)
+{
+  vector<Column> ret;
+  for (const auto & spec : columns.getValue())
+    {
+      vector<string> parts;
+      for (size_t pos = 0, next; ; pos = next + 1)
+	{
+	  next = spec.find(':', pos);
+	  parts.push_back(spec.substr(pos, next - pos));
+	  if (next == string::npos)
+	    break;
+	}
+      if (parts.size() < 2 or parts.size() > 3)
+	{
+	  cout << "Invalid column spec " << spec << endl;
+	  abort();
+	}
+
+      // search the column by header field, annotated name or position
+      const string & name = parts[0];
+      size_t index = header.size();
+      string annotation, base;
+      for (size_t i = 0; i < header.size() and index == header.size(); ++i)
+	{
+	  const Field f = unquote(header[i]);
+	  const string field(f.begin, f.end);
+	  const size_t open = field.rfind('[');
+	  const bool annotated = open != string::npos and field.back() == ']';
+	  const string field_base = annotated ? field.substr(0, open) : field;
+	  if (field == name or (annotated and field_base == name))
+	    {
+	      index = i;
+	      if (annotated)
+		{
+		  base = field_base;
+		  annotation = field.substr(open + 1, field.size() - open - 2);
+		}
+	    }
+	}
+      if (index == header.size() and not name.empty() and
+	  name.find_first_not_of("0123456789") == string::npos)
+	index = stoul(name);
+      if (index >= header.size())
+	{
+	  cout << "Column " << name << " not found in header" << endl;
+	  abort();
+	}
+      for (const auto & col : ret)
+	if (col.index == index)
+	  {
+	    cout << "Column " << name << " (" << index << ") is given more "
+		 << "than once" << endl;
+	    abort();
+	  }
+
+      const Unit * src = nullptr;
+      if (parts.size() == 3)
+	src = search_unit(parts[1]);
+      else if (annotation.empty())
+	{
+	  cout << "Column " << name << " has not unit annotation; "
+	       << "source unit must be given" << endl;
+	  abort();
+	}
+      else
+	src = search_unit(annotation);
+      const Unit * tgt = search_unit(parts.back());
+
+      string header_field(header[index].begin, header[index].end);
+      if (not annotation.empty())
+	{
+	  const Field f = unquote(header[index]);
+	  header_field = string(header[index].begin, f.begin) + base + "[" +
+	    parts.back() + "]" +
+	    string(f.end, header[index].end);
+	}
+
+      ret.push_back({index, ConversionPlan(*src, *tgt), header_field, {}});
+    }
+
+  // the header and the records are rewritten in the order of the fields
+  sort(ret.begin(), ret.end(), [] (const Column & c1, const Column & c2)
+       {
+	 return c1.index < c2.index;
+       });
+
+  return ret;
+}
+
+class CsvConverter
+{
+  struct Span
+  {
+    const char * begin;
+    const char * end;
+    size_t column;
+  };
+
+  vector<Column> cols;
+  vector<size_t> col_of_field; // column of a field or cols.size()
+  vector<Field> fields;
+  vector<Span> spans;
+  vector<char> out;
+  size_t line = 1;
+
+  // Convert the values gathered from the records of [begin, end) and
+  // write these records in fd with the converted fields
+  void write(const char * begin, const char * end, int fd)
+  {
+    for (auto & col : cols)
+      col.plan(col.vals.data(), col.vals.data(), col.vals.size());
+
+    out.resize(end - begin + spans.size()*Max_Double_Length);
+    char * ptr = out.data();
+    const char * copied = begin;
+    vector<size_t> idx(cols.size(), 0);
+    for (const auto & span : spans)
+      {
+	memcpy(ptr, copied, span.begin - copied);
+	ptr += span.begin - copied;
+	ptr += format_double(cols[span.column].vals[idx[span.column]++],
+			     precision.getValue(), ptr);
+	copied = span.end;
+      }
+    memcpy(ptr, copied, end - copied);
+    ptr += end - copied;
+
+    write_fully(fd, out.data(), ptr - out.data());
+  }
+
+public:
+
+  CsvConverter(vector<Column> && columns, size_t num_fields,
+	       size_t first_line)
+    : cols(move(columns)), line(first_line)
+  {
+    col_of_field.assign(num_fields, cols.size());
+    for (size_t i = 0; i < cols.size(); ++i)
+      col_of_field[cols[i].index] = i;
+  }
+
+  // Convert the complete records of [begin, end) and write them in
+  // fd. Return the end of the last complete record (all of them if
+  // last_block). On an invalid record, the records before it are
+  // written and InvalidCsvRow is thrown
+  const char * convert(const char * begin, const char * end, bool last_block,
+		       int fd)
+  {
+    spans.clear();
+    for (auto & col : cols)
+      col.vals.clear();
+
+    const char * p = begin;
+    while (p < end)
+      {
+	fields.clear();
+	const char * next = scan_record(p, end, fields, last_block);
+	if (next == nullptr)
+	  break;
+
+	const size_t num_spans = spans.size();
+	for (size_t i = 0; i < fields.size() and i < col_of_field.size(); ++i)
+	  {
+	    const size_t c = col_of_field[i];
+	    if (c == cols.size())
+	      continue;
+	    const Field f = unquote(fields[i]);
+	    if (f.begin == f.end)
+	      continue;
+	    double val;
+	    const char * num_end = parse_double(f.begin, f.end, val);
+	    if (num_end != f.end)
+	      {
+		// drop the fields of this record and write the previous ones
+		for (; spans.size() > num_spans; spans.pop_back())
+		  cols[spans.back().column].vals.pop_back();
+		write(begin, p, fd);
+
+		ostringstream s;
+		s << "line " << line << ": field " << i << " '"
+		  << string(f.begin, f.end) << "' is not a number";
+		ZENTHROW(InvalidCsvRow, s.str());
+	      }
+	    cols[c].vals.push_back(val);
+	    // only the number is replaced; blanks and quotes are kept
+	    spans.push_back({f.begin, f.end, c});
+	  }
+
+	line += count(p, next, '\n');
+	p = next;
+      }
+
+    write(begin, p, fd);
+    return p;
+  }
+};
+
+void convert(int in_fd, int out_fd)
+{
+  const size_t bsize = max<size_t>(block_size.getValue(), 16);
+  vector<char> buf(bsize + 1);
+  size_t len = 0;
+  bool eof = false;
+
+  // fill the buffer until it holds the whole header
+  vector<Field> header;
+  const char * header_end = nullptr;
+  while (not eof)
+    {
+      if (len == buf.size() - 1)
+	buf.resize(2*buf.size());
+      const size_t n = read_some(in_fd, buf.data() + len, buf.size() - 1 - len);
+      len += n;
+      eof = n == 0;
+      buf[len] = '\0';
+      header.clear();
+      header_end = scan_record(buf.data(), buf.data() + len, header, eof);
+      if (header_end != nullptr)
+	break;
+    }
+  if (len == 0)
+    ZENTHROW(InvalidCsvHeader, "empty csv file");
+
+  vector<Column> cols = resolve_columns(header);
+
+  // write the header with the rewritten annotations
+  string head;
+  const char * copied = buf.data();
+  for (const auto & col : cols)
+    if (col.header.size() != size_t(header[col.index].end -
+				    header[col.index].begin) or
+	not equal(col.header.begin(), col.header.end(),
+		  header[col.index].begin))
+      {
+	head.append(copied, header[col.index].begin);
+	head += col.header;
+	copied = header[col.index].end;
+      }
+  head.append(copied, header_end);
+  write_fully(out_fd, head.data(), head.size());
+
+  CsvConverter conv(move(cols), header.size(),
+		    1 + count<const char *>(buf.data(), header_end, '\n'));
+
+  size_t start = header_end - buf.data();
+  while (true)
+    {
+      const char * done = conv.convert(buf.data() + start, buf.data() + len,
+				       eof, out_fd);
+      if (eof)
+	break;
+
+      // keep the incomplete record and read more
+      len = buf.data() + len - done;
+      memmove(buf.data(), done, len);
+      start = 0;
+      if (len == buf.size() - 1)
+	buf.resize(2*buf.size()); // record longer than the buffer
+      const size_t n = read_some(in_fd, buf.data() + len, buf.size() - 1 - len);
+      len += n;
+      eof = n == 0;
+      buf[len] = '\0';
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  int in_fd = STDIN_FILENO, out_fd = STDOUT_FILENO;
+  if (file.isSet())
+    {
+      in_fd = open(file.getValue().c_str(), O_RDONLY);
+      if (in_fd < 0)
+	{
+	  cout << "Cannot open " << file.getValue() << endl;
+	  abort();
+	}
+    }
+  if (output.isSet())
+    {
+      out_fd = open(output.getValue().c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+		    0644);
+      if (out_fd < 0)
+	{
+	  cout << "Cannot open " << output.getValue() << endl;
+	  abort();
+	}
+    }
+
+  try
+    {
+      convert(in_fd, out_fd);
+    }
+  catch (ZenException & e)
+    {
+      cerr << e.type << ": " << e.msg << endl;
+      return 1;
+    }
+
+  close(in_fd);
+  close(out_fd);
+}
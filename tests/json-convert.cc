@@ -0,0 +1,518 @@
+# include <fcntl.h>
+# include <unistd.h>
+# include <map>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <conversion-stream.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+/* Unit conversion of JSON lines
+
+   Every line of the input is a JSON record. A quantity is annotated
+   as an object with the members "value" (a number) and "unit" (a unit
+   symbol or name), for example
+
+       {"well": "A-12", "p": {"value": 512.3, "unit": "psig"}}
+
+   The target unit of a quantity is given by the name of the member
+   holding it (-c p:kPa) or, failing that, by its physical quantity
+   (-T kPa converts every pressure). Quantities without target or
+   whose unit is unknown are left as they are.
+
+   The records are not built as objects: each line is scanned once,
+   validating its syntax and locating the annotated quantities, and
+   then written back replacing only the text of their value and unit;
+   the rest of the line is copied byte for byte. The memory is bounded
+   by the longest line. The converted values are written with the
+   shortest text that is read back as the same double; -P rounds them
+   to fewer digits.
+
+   A record that is not valid JSON, that repeats the member "value" or
+   "unit" of an object or whose value is out of the range of its unit
+   stops the conversion: the records before it are written, the error
+   is reported with its line number and the exit code is 1.
+*/
+
+CmdLine cmd = { "json-convert", ' ', "0" };
+
+ValueArg<string> file = { "f", "file", "input file (stdin by default)",
+			  false, "", "input file name", cmd };
+
+MultiArg<string> members = { "c", "column", "target unit of the quantities "
+			     "held by a member as member:target-unit", false,
+			     "member spec", cmd };
+
+MultiArg<string> targets = { "T", "target-unit", "target unit of every "
+			     "quantity of its physical quantity", false,
+			     "target unit", cmd };
+
+ValueArg<int> precision = { "P", "precision", "significant digits of the "
+			    "converted values (default: the shortest text "
+			    "read back as the same double)", false,
+			    Shortest_Round_Trip, "precision", cmd };
+
+struct Span
+{
+  const char * begin = nullptr;
+  const char * end = nullptr;
+
+  string str() const { return string(begin, end); }
+};
+
+// An annotated quantity found in a record
+struct Annotation
+{
+  Span key;   // member holding the object (empty in arrays)
+  Span value; // number token
+  Span unit;  // string contents (without quotes)
+};
+
+// Validating scanner of a JSON text that collects the annotations
+class JsonScanner
+{
+  static constexpr size_t Max_Depth = 512;
+
+  const char * p;
+  const char * const end;
+  const char * const begin;
+  vector<Annotation> & found;
+  size_t depth = 0;
+
+  [[noreturn]] void error(const char * msg)
+  {
+    ostringstream s;
+    s << msg << " at column " << p - begin + 1;
+    ZENTHROW(InvalidValue, s.str());
+  }
+
+  void skip_blanks()
+  {
+    while (p < end and (*p == ' ' or *p == '\t' or *p == '\r' or *p == '\n'))
+      ++p;
+  }
+
+  void expect(char c)
+  {
+    skip_blanks();
+    if (p == end or *p != c)
+      error("unexpected character");
+    ++p;
+  }
+
+  // string token; return its contents and whether it has escapes
+  Span string_token(bool & escaped)
+  {
+    escaped = false;
+    if (p == end or *p != '"')
+      error("string expected");
+    Span s;
+    s.begin = ++p;
+    for (; p < end and *p != '"'; ++p)
+      if (*p == '\\')
+	{
+	  escaped = true;
+	  if (++p == end)
+	    break;
+	}
+      else if (static_cast<unsigned char>(*p) < 0x20)
+	error("control character in string");
+    if (p == end)
+      error("unterminated string");
+    s.end = p++;
+    return s;
+  }
+
+  Span number_token()
+  {
+    Span s;
+    s.begin = p;
+    auto digits = [this] ()
+      {
+	const char * start = p;
+	while (p < end and *p >= '0' and *p <= '9')
+	  ++p;
+	if (p == start)
+	  error("invalid number");
+      };
+
+    if (p < end and *p == '-')
+      ++p;
+    if (p < end and *p == '0')
+      ++p;
+    else
+      digits();
+    if (p < end and *p == '.')
+      {
+	++p;
+	digits();
+      }
+    if (p < end and (*p == 'e' or *p == 'E'))
+      {
+	++p;
+	if (p < end and (*p == '+' or *p == '-'))
+	  ++p;
+	digits();
+      }
+    s.end = p;
+    return s;
+  }
+
+  void literal(const char * word)
+  {
+    const size_t len = strlen(word);
+    if (size_t(end - p) < len or strncmp(p, word, len) != 0)
+      error("invalid literal");
+    p += len;
+  }
+
+  // scan a value; return the kind of token: 's'tring, 'n'umber or 'o'ther
+  char value(const Span & key, Span & token)
+  {
+    skip_blanks();
+    if (p == end)
+      error("value expected");
+
+    switch (*p)
+      {
+      case '{': object(key); return 'o';
+      case '[': array(); return 'o';
+      case '"':
+	{
+	  bool escaped;
+	  token = string_token(escaped);
+	  return escaped ? 'o' : 's';
+	}
+      case 't': literal("true"); return 'o';
+      case 'f': literal("false"); return 'o';
+      case 'n': literal("null"); return 'o';
+      default:
+	token = number_token();
+	return 'n';
+      }
+  }
+
+  void nest()
+  {
+    if (++depth > Max_Depth)
+      error("too deeply nested");
+    ++p;
+    skip_blanks();
+  }
+
+  void object(const Span & key)
+  {
+    nest();
+    Annotation ann;
+    ann.key = key;
+    bool has_value = false, has_unit = false;
+    bool seen_value = false, seen_unit = false; // of any kind
+    if (p < end and *p == '}')
+      ++p;
+    else
+      while (true)
+	{
+	  skip_blanks();
+	  bool escaped;
+	  const Span member = string_token(escaped);
+	  const size_t len = member.end - member.begin;
+	  const bool is_value =
+	    len == 5 and strncmp(member.begin, "value", 5) == 0;
+	  const bool is_unit =
+	    len == 4 and strncmp(member.begin, "unit", 4) == 0;
+	  // a repeated member could not be told apart from the converted one
+	  if (is_value and seen_value)
+	    error("duplicate member \"value\"");
+	  if (is_unit and seen_unit)
+	    error("duplicate member \"unit\"");
+	  seen_value |= is_value;
+	  seen_unit |= is_unit;
+
+	  expect(':');
+	  Span token;
+	  const char kind = value(member, token);
+	  if (is_value and kind == 'n')
+	    {
+	      ann.value = token;
+	      has_value = true;
+	    }
+	  else if (is_unit and kind == 's')
+	    {
+	      ann.unit = token;
+	      has_unit = true;
+	    }
+
+	  skip_blanks();
+	  if (p < end and *p == ',')
+	    {
+	      ++p;
+	      continue;
+	    }
+	  expect('}');
+	  break;
+	}
+    --depth;
+
+    if (has_value and has_unit)
+      found.push_back(ann);
+  }
+
+  void array()
+  {
+    nest();
+    if (p < end and *p == ']')
+      ++p;
+    else
+      while (true)
+	{
+	  Span token;
+	  value(Span(), token);
+	  skip_blanks();
+	  if (p < end and *p == ',')
+	    {
+	      ++p;
+	      continue;
+	    }
+	  expect(']');
+	  break;
+	}
+    --depth;
+  }
+
+public:
+
+  JsonScanner(const char * begin, const char * end,
+	      vector<Annotation> & found)
+    : p(begin), end(end), begin(begin), found(found) {}
+
+  /// Scan a complete JSON text (blanks only mean an empty record)
+  void scan()
+  {
+    skip_blanks();
+    if (p == end)
+      return;
+    Span token;
+    value(Span(), token);
+    skip_blanks();
+    if (p != end)
+      error("trailing characters after JSON value");
+  }
+};
+
+class JsonConverter
+{
+  map<string, const Unit *> member_targets;
+  map<const PhysicalQuantity *, const Unit *> pq_targets;
+  map<string, const Unit *> units; // cache of unit searches
+  map<pair<const Unit *, const Unit *>, ConversionPlan> plans;
+  vector<Annotation> found;
+  size_t line = 0;
+
+  const Unit * unit_of(const Span & s)
+  {
+    string name = s.str();
+    auto it = units.find(name);
+    if (it == units.end())
+      it = units.emplace(name, Unit::search(name)).first;
+    return it->second;
+  }
+
+  const Unit * target_of(const Annotation & ann, const Unit & src)
+  {
+    if (ann.key.begin != nullptr)
+      {
+	auto it = member_targets.find(ann.key.str());
+	if (it != member_targets.end())
+	  return it->second;
+      }
+    auto it = pq_targets.find(&src.physical_quantity);
+    return it == pq_targets.end() ? nullptr : it->second;
+  }
+
+  const ConversionPlan & plan_of(const Unit & src, const Unit & tgt)
+  {
+    const auto key = make_pair(&src, &tgt);
+    auto it = plans.find(key);
+    if (it == plans.end())
+      it = plans.emplace(key, ConversionPlan(src, tgt)).first;
+    return it->second;
+  }
+
+  void check_range(double val, const Unit & unit) const
+  {
+    if (BaseQuantity::is_valid(val, unit))
+      return;
+
+    ostringstream s;
+    s << "value " << val << " is not inside in ["
+      << unit.min_val << ", " << unit.max_val << "] defined for the unit "
+      << unit.name;
+    ZENTHROW(OutOfUnitRange, s.str());
+  }
+
+public:
+
+  /// Number of the last record converted (or being converted)
+  size_t line_number() const noexcept { return line; }
+
+  JsonConverter()
+  {
+    for (const auto & spec : members.getValue())
+      {
+	const size_t pos = spec.rfind(':');
+	if (pos == string::npos)
+	  {
+	    cout << "Invalid member spec " << spec << endl;
+	    abort();
+	  }
+	member_targets[spec.substr(0, pos)] =
+	  search_unit(spec.substr(pos + 1));
+      }
+
+    for (const auto & name : targets.getValue())
+      {
+	const Unit * unit = search_unit(name);
+	pq_targets[&unit->physical_quantity] = unit;
+      }
+  }
+
+  // Convert the record [begin, end) and append it to out
+  void convert(const char * begin, const char * end, string & out)
+  {
+    ++line;
+    found.clear();
+    JsonScanner(begin, end, found).scan();
+
+    struct Replacement
+    {
+      Span span;
+      string text;
+    };
+    vector<Replacement> replacements;
+    char buf[Max_Double_Length];
+    for (const auto & ann : found)
+      {
+	const Unit * src = unit_of(ann.unit);
+	if (src == nullptr)
+	  continue;
+	const Unit * tgt = target_of(ann, *src);
+	if (tgt == nullptr or tgt == src)
+	  continue;
+
+	double val;
+	parse_double(ann.value.begin, ann.value.end, val);
+	check_range(val, *src);
+	val = plan_of(*src, *tgt)(val);
+	check_range(val, *tgt);
+
+	const size_t len = format_double(val, precision.getValue(), buf);
+	replacements.push_back({ ann.value, string(buf, len) });
+	replacements.push_back({ ann.unit, tgt->symbol });
+      }
+
+    sort(replacements.begin(), replacements.end(),
+	 [] (const Replacement & r1, const Replacement & r2)
+	 {
+	   return r1.span.begin < r2.span.begin;
+	 });
+
+    const char * copied = begin;
+    for (const auto & r : replacements)
+      {
+	out.append(copied, r.span.begin);
+	out += r.text;
+	copied = r.span.end;
+      }
+    out.append(copied, end);
+  }
+};
+
+// Convert the records of in_fd and write them to out_fd. On an invalid
+// record the records before it are written and the error is reported
+// with its line number; then false is returned
+bool convert(int in_fd, int out_fd)
+{
+  JsonConverter conv;
+  const size_t block_size = 1 << 20;
+  vector<char> buf(block_size);
+  string out;
+  size_t len = 0;
+  bool eof = false;
+  try
+    {
+      while (not eof)
+	{
+	  if (len == buf.size())
+	    buf.resize(2*buf.size()); // line longer than the buffer
+	  const size_t n = read_some(in_fd, buf.data() + len, buf.size() - len);
+	  len += n;
+	  eof = n == 0;
+
+	  const char * p = buf.data();
+	  const char * const end = p + len;
+	  while (p < end)
+	    {
+	      const char * nl =
+		static_cast<const char*>(memchr(p, '\n', end - p));
+	      if (nl == nullptr and not eof)
+		break;
+	      const char * line_end = nl == nullptr ? end : nl;
+	      conv.convert(p, line_end, out);
+	      if (nl != nullptr)
+		out += '\n';
+	      p = nl == nullptr ? end : nl + 1;
+	    }
+
+	  if (out.size() >= block_size or eof)
+	    {
+	      write_fully(out_fd, out.data(), out.size());
+	      out.clear();
+	    }
+
+	  len = end - p;
+	  memmove(buf.data(), p, len);
+	}
+    }
+  catch (ZenException & e)
+    {
+      write_fully(out_fd, out.data(), out.size());
+      cerr << "line " << conv.line_number() << ": " << e.type << ": "
+	   << e.msg << endl;
+      return false;
+    }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  int in_fd = STDIN_FILENO;
+  if (file.isSet())
+    {
+      in_fd = open(file.getValue().c_str(), O_RDONLY);
+      if (in_fd < 0)
+	{
+	  cout << "Cannot open " << file.getValue() << endl;
+	  abort();
+	}
+    }
+
+  bool ok;
+  try
+    {
+      ok = convert(in_fd, STDOUT_FILENO);
+    }
+  catch (ZenException & e) // failed writing out what was converted
+    {
+      cerr << e.type << ": " << e.msg << endl;
+      return 1;
+    }
+  close(in_fd);
+
+  return ok ? 0 : 1;
+}
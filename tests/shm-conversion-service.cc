@@ -0,0 +1,178 @@
+# include <csignal>
+# include <map>
+# include <memory>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <quantity-array.H>
+# include <conversion-protocol.H>
+# include <shm-ring.H>
+
+using namespace TCLAP;
+
+/* Conversion service on shared memory rings
+
+   Creates an input and an output ring (see shm-ring.H) and converts
+   every record of the input ring into a record of the output ring
+   with the same tag. The values are read from the input ring and the
+   results written into the output ring by a single call to the batch
+   interface of the plan of the pair, without intermediate copies.
+
+   The status of a result is one of `ReplyStatus` of
+   conversion-protocol.H; a failed record has no values. The records
+   are validated before being read: a record whose count does not fit
+   in the ring is answered with `Reply_Bad_Request` and, since the
+   following records cannot be delimited anymore, all the records
+   published so far are dropped. The rings are removed when the
+   service is interrupted or fails.
+*/
+
+CmdLine cmd = { "shm-conversion-service", ' ', "0" };
+
+ValueArg<string> input = { "i", "input", "name of the input ring", false,
+			   "/zen-conversion-in", "ring name", cmd };
+
+ValueArg<string> output = { "o", "output", "name of the output ring", false,
+			    "/zen-conversion-out", "ring name", cmd };
+
+ValueArg<size_t> capacity = { "c", "capacity", "size in bytes of the rings",
+			      false, 16 << 20, "bytes", cmd };
+
+volatile sig_atomic_t stop = 0;
+
+void request_stop(int) { stop = 1; }
+
+class Service
+{
+  vector<const Unit *> units_by_id;
+  map<pair<uint32_t, uint32_t>, unique_ptr<ConversionPlan>> plans;
+  ShmRing in, out;
+
+  // Return the plan of rec or nullptr with the error in status
+  const ConversionPlan * plan_of(const RingRecord & rec, int32_t & status)
+  {
+    const auto key = make_pair(rec.src_id, rec.tgt_id);
+    auto it = plans.find(key);
+    if (it != plans.end())
+      return it->second.get();
+
+    if (rec.src_id >= units_by_id.size() or rec.tgt_id >= units_by_id.size())
+      {
+	status = Reply_Unit_Not_Found;
+	return nullptr;
+      }
+
+    if (search_conversion(*units_by_id[rec.src_id],
+			  *units_by_id[rec.tgt_id]) == nullptr)
+      {
+	status = Reply_Conversion_Not_Found;
+	return nullptr;
+      }
+
+    return (plans[key] =
+	    make_unique<ConversionPlan>(*units_by_id[rec.src_id],
+					*units_by_id[rec.tgt_id])).get();
+  }
+
+  void convert(const RingRecord & rec)
+  {
+    int32_t status = Reply_Ok;
+    const ConversionPlan * plan = plan_of(rec, status);
+    if (plan != nullptr)
+      try
+	{
+	  check_values(plan->source_unit(), rec.values(), rec.count);
+	}
+      catch (OutOfUnitRange &)
+	{
+	  status = Reply_Out_Of_Range;
+	}
+
+    const uint64_t count = status == Reply_Ok ? rec.count : 0;
+    RingRecord * res = reply(rec, status, count);
+    if (res == nullptr)
+      return;
+    if (count > 0)
+      (*plan)(rec.values(), res->values(), count);
+    out.commit();
+  }
+
+  // Reserve the result of rec with count values; nullptr if stopped
+  RingRecord * reply(const RingRecord & rec, int32_t status, uint64_t count)
+  {
+    RingRecord * res;
+    RingBackoff backoff;
+    while ((res = out.reserve(rec.src_id, rec.tgt_id, count)) == nullptr and
+	   not stop)
+      backoff.wait();
+    if (res == nullptr)
+      return nullptr;
+    res->tag = rec.tag;
+    res->status = status;
+    return res;
+  }
+
+public:
+
+  Service()
+    : in(ShmRing::create(input.getValue(), capacity.getValue())),
+      out(ShmRing::create(output.getValue(), capacity.getValue()))
+  {
+    units_by_id.resize(Unit::size());
+    Unit::units().for_each([this] (const Unit * ptr)
+			   {
+			     units_by_id[ptr->get_id()] = ptr;
+			   });
+  }
+
+  ~Service()
+  {
+    ShmRing::remove(input.getValue());
+    ShmRing::remove(output.getValue());
+  }
+
+  void run()
+  {
+    RingBackoff backoff;
+    while (not stop)
+      {
+	const RingRecord * rec = in.front();
+	if (rec == nullptr)
+	  {
+	    backoff.wait();
+	    continue;
+	  }
+	backoff.reset();
+	if (not in.is_valid(*rec))
+	  {
+	    if (reply(*rec, Reply_Bad_Request, 0) != nullptr)
+	      out.commit();
+	    in.skip_all();
+	    continue;
+	  }
+	convert(*rec);
+	in.pop();
+      }
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  signal(SIGINT, request_stop);
+  signal(SIGTERM, request_stop);
+
+  Service service;
+  cout << "Serving " << input.getValue() << " -> " << output.getValue()
+       << endl;
+  try
+    {
+      service.run();
+    }
+  catch (exception & e)
+    {
+      cout << e.what() << endl;
+      return 1; // ~Service removes the rings
+    }
+}
@@ -0,0 +1,130 @@
+# include <chrono>
+# include <random>
+
+# include <tclap/CmdLine.h>
+# include <units-list.H>
+# include <conversion-protocol.H>
+# include <shm-ring.H>
+
+# include "tool-utils.H"
+
+using namespace TCLAP;
+
+/* Test producer of shm-conversion-service
+
+   Writes records of random values inside the range of the source unit
+   into the input ring of the service while it reads the results of
+   the output ring, verifies every result against the local conversion
+   and prints the throughput and the latency of the round trips.
+
+   The unit ids are those of the library, which must be the same build
+   as the one of the service.
+*/
+
+CmdLine cmd = { "shm-producer", ' ', "0" };
+
+ValueArg<string> input = { "i", "input", "name of the input ring", false,
+			   "/zen-conversion-in", "ring name", cmd };
+
+ValueArg<string> output = { "o", "output", "name of the output ring", false,
+			    "/zen-conversion-out", "ring name", cmd };
+
+ValueArg<string> source = {"S", "source-unit", "source unit", true,
+			   "", "source unit", cmd};
+ValueArg<string> target = {"T", "target-unit", "target unit", true,
+			   "", "target unit", cmd};
+
+ValueArg<size_t> num_records = { "r", "records", "number of records", false,
+				 100000, "number of records", cmd };
+
+ValueArg<size_t> num_values = { "n", "num-values",
+				"number of values per record", false, 64,
+				"number of values", cmd };
+
+ValueArg<unsigned long> seed = { "e", "seed", "seed of the random values",
+				 false, 0, "seed", cmd };
+
+int main(int argc, char *argv[])
+{
+  cmd.parse(argc, argv);
+
+  const Unit & src_unit = *search_unit(source.getValue());
+  const Unit & tgt_unit = *search_unit(target.getValue());
+  const ConversionPlan plan(src_unit, tgt_unit);
+
+  ShmRing in = ShmRing::open(input.getValue());
+  ShmRing out = ShmRing::open(output.getValue());
+
+  const size_t n = num_values.getValue(), num = num_records.getValue();
+  if (num == 0)
+    return 0;
+
+  uniform_real_distribution<double> dist(src_unit.min_val, src_unit.max_val);
+  auto generate = [&dist, n] (uint64_t tag, double * vals)
+    {
+      mt19937_64 rng(seed.getValue() ^ tag*0x9e3779b97f4a7c15ULL);
+      for (size_t i = 0; i < n; ++i)
+	vals[i] = dist(rng);
+    };
+
+  using Clock = chrono::steady_clock;
+  vector<Clock::time_point> sent(num);
+  vector<double> latencies(num), vals(n), expected(n);
+  size_t num_sent = 0, num_received = 0, num_wrong = 0, num_failed = 0;
+  RingBackoff backoff;
+  const auto start = Clock::now();
+  while (num_received < num)
+    {
+      bool progress = false;
+      if (num_sent < num)
+	{
+	  RingRecord * rec = in.reserve(src_unit.get_id(), tgt_unit.get_id(),
+					n);
+	  if (rec != nullptr)
+	    {
+	      rec->tag = num_sent;
+	      generate(num_sent, rec->values());
+	      sent[num_sent++] = Clock::now();
+	      in.commit();
+	      progress = true;
+	    }
+	}
+
+      const RingRecord * res = out.front();
+      if (res != nullptr)
+	{
+	  const chrono::duration<double, micro> latency =
+	    Clock::now() - sent[res->tag];
+	  latencies[num_received++] = latency.count();
+	  if (res->status != Reply_Ok)
+	    ++num_failed;
+	  else
+	    {
+	      generate(res->tag, vals.data());
+	      plan(vals.data(), expected.data(), n);
+	      for (size_t i = 0; i < n; ++i)
+		num_wrong += res->values()[i] != expected[i];
+	    }
+	  out.pop();
+	  progress = true;
+	}
+
+      if (progress)
+	backoff.reset();
+      else
+	backoff.wait();
+    }
+  const chrono::duration<double> elapsed = Clock::now() - start;
+
+  sort(latencies.begin(), latencies.end());
+  cout << num << " records in " << elapsed.count() << " s ("
+       << num/elapsed.count() << " records/s, "
+       << num*n/elapsed.count()/1e6 << " million values/s)" << endl
+       << "round trip latency (us): median " << latencies[num/2]
+       << ", p99 " << latencies[min(num - 1, num*99/100)] << ", max "
+       << latencies.back() << endl
+       << num_failed << " failed records, " << num_wrong << " wrong values"
+       << endl;
+
+  return num_failed == 0 and num_wrong == 0 ? 0 : 1;
+}
@@ -4,6 +4,10 @@
 # include <cmath>
 # include <memory>
 # include <algorithm>
+# include <atomic>
+# include <chrono>
+# include <cstring>
+# include <thread>
 
 # include <tclap/CmdLine.h>
 
@@ -81,7 +85,7 @@ generate_row(const Unit & unit, double val, double epsilon, bool verbose)
 	  throw range_error(s.str());
 	}
 
-      conversions.append(to_string(conv.get_value(), precision));
+      conversions.append(double_to_string(conv.get_value(), precision));
     }
 
   return conversions;
@@ -113,8 +117,8 @@ test_extremes_conversions(const PhysicalQuantity & pq, bool verbose,
 
       DynList<string> row;
       row.append(unit_ptr->name);
-      row.append(to_string(min));
-      row.append(to_string(max));
+      row.append(fixed_to_string(min));
+      row.append(fixed_to_string(max));
       row.append(conversions);
 
       rows.append(row);
@@ -193,7 +197,7 @@ test_random_conversions(const PhysicalQuantity & pq, bool verbose,
       
       DynList<string> ret;
       ret.append(p.first->name);
-      ret.append(samples.maps<string>([] (auto v) { return to_string(v); }));
+      ret.append(samples.maps<string>([] (auto v) { return fixed_to_string(v); }));
       ret.append(conversions);
 
       return ret;
@@ -221,6 +225,208 @@ test_random_conversions(const PhysicalQuantity & pq, bool verbose,
   return ret;
 }
 
+/* Round-trip sweep
+
+   For every pair (src, tgt) of distinct units of the same physical
+   quantity, num_samples uniform values v of the src range (limited to
+   max) are converted to tgt and back to src with the conversion
+   functions, and the error of the returned value w is measured in ulps
+   (the number of doubles between v and w) and relative to v. The
+   pairs are distributed among the threads; every pair has its own
+   generator seeded from the seed and the index of the pair, so the
+   results do not depend on the number of threads nor on the
+   scheduling. A pair fails when |v - w| > epsilon for some sample or
+   when its conversions are missing. */
+
+struct RoundTrip
+{
+  const PhysicalQuantity * pq = nullptr;
+  const Unit * src = nullptr;
+  const Unit * tgt = nullptr;
+  bool missing = false;
+  size_t num_failures = 0;
+  uint64_t max_ulps = 0;
+  double max_ulps_val = 0;
+  double max_rel = 0;
+  double max_rel_val = 0;
+  double mean_ulps = 0;
+};
+
+// Map val to an integer whose order is that of the doubles
+static int64_t ordered_bits(double val)
+{
+  int64_t bits;
+  memcpy(&bits, &val, sizeof(bits));
+  return bits < 0 ? numeric_limits<int64_t>::min() - bits : bits;
+}
+
+static uint64_t ulps_between(double x, double y)
+{
+  if (isnan(x) or isnan(y))
+    return numeric_limits<uint64_t>::max();
+  const int64_t ix = ordered_bits(x), iy = ordered_bits(y);
+  return ix > iy ? uint64_t(ix) - uint64_t(iy) : uint64_t(iy) - uint64_t(ix);
+}
+
+// splitmix64 of the seed and the pair index
+static unsigned long pair_seed(unsigned long seed, size_t idx)
+{
+  uint64_t z = seed + (idx + 1)*0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+void round_trip(RoundTrip & rt, size_t num_samples, double max,
+		double epsilon, gsl_rng * r)
+{
+  const Unit_Convert_Fct_Ptr to = search_conversion(*rt.src, *rt.tgt);
+  const Unit_Convert_Fct_Ptr from = search_conversion(*rt.tgt, *rt.src);
+  if (to == nullptr or from == nullptr)
+    {
+      rt.missing = true;
+      return;
+    }
+
+  const double min = rt.src->min_val;
+  const double urange = std::min(rt.src->max_val - min, max);
+  constexpr size_t Block = 1024;
+  double vals[Block], back[Block];
+  double sum_ulps = 0;
+  for (size_t done = 0; done < num_samples; done += Block)
+    {
+      const size_t n = std::min(Block, num_samples - done);
+      for (size_t i = 0; i < n; ++i)
+	vals[i] = min + urange*gsl_rng_uniform(r);
+      for (size_t i = 0; i < n; ++i)
+	back[i] = from(to(vals[i]));
+
+      for (size_t i = 0; i < n; ++i)
+	{
+	  const double v = vals[i], w = back[i];
+	  const double err = fabs(v - w);
+	  if (not (err <= epsilon))
+	    ++rt.num_failures;
+
+	  const uint64_t u = ulps_between(v, w);
+	  sum_ulps += u;
+	  if (u > rt.max_ulps)
+	    {
+	      rt.max_ulps = u;
+	      rt.max_ulps_val = v;
+	    }
+
+	  const double rel = v == 0 ? err : err/fabs(v);
+	  if (rel > rt.max_rel or (isnan(rel) and not isnan(rt.max_rel)))
+	    {
+	      rt.max_rel = rel;
+	      rt.max_rel_val = v;
+	    }
+	}
+    }
+  rt.mean_ulps = num_samples > 0 ? sum_ulps/num_samples : 0;
+}
+
+int sweep_round_trips(const DynList<const PhysicalQuantity*> & quantities,
+		      size_t num_samples, double max, double epsilon,
+		      unsigned long seed, size_t num_threads, size_t num_worst,
+		      bool csv)
+{
+  vector<RoundTrip> pairs;
+  for (auto it = quantities.get_it(); it.has_curr(); it.next())
+    {
+      const PhysicalQuantity * pq = it.get_curr();
+      for (auto sit = pq->units().get_it(); sit.has_curr(); sit.next())
+	for (auto tit = pq->units().get_it(); tit.has_curr(); tit.next())
+	  if (sit.get_curr() != tit.get_curr())
+	    {
+	      RoundTrip rt;
+	      rt.pq = pq;
+	      rt.src = sit.get_curr();
+	      rt.tgt = tit.get_curr();
+	      pairs.push_back(rt);
+	    }
+    }
+
+  const auto start = chrono::steady_clock::now();
+  atomic<size_t> next(0);
+  auto work = [&] ()
+    {
+      unique_ptr<gsl_rng, decltype(gsl_rng_free)*>
+	r(gsl_rng_alloc(gsl_rng_mt19937), gsl_rng_free);
+      for (size_t i = next++; i < pairs.size(); i = next++)
+	{
+	  gsl_rng_set(r.get(), pair_seed(seed, i) % gsl_rng_max(r.get()));
+	  round_trip(pairs[i], num_samples, max, epsilon, r.get());
+	}
+    };
+
+  vector<thread> threads;
+  for (size_t i = 1; i < num_threads; ++i)
+    threads.emplace_back(work);
+  work();
+  for (auto & t : threads)
+    t.join();
+  const double secs =
+    chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  vector<const RoundTrip*> worst;
+  size_t num_failed = 0;
+  for (const auto & rt : pairs)
+    {
+      worst.push_back(&rt);
+      if (rt.missing)
+	{
+	  ++num_failed;
+	  cout << "Missing conversion between " << rt.src->symbol << " and "
+	       << rt.tgt->symbol << endl;
+	}
+      else if (rt.num_failures > 0)
+	{
+	  ++num_failed;
+	  cout << rt.num_failures << " round trips " << rt.src->symbol
+	       << " -> " << rt.tgt->symbol << " -> " << rt.src->symbol
+	       << " do not satisfy epsilon threshold " << epsilon << endl;
+	}
+    }
+
+  stable_sort(worst.begin(), worst.end(), [] (auto p1, auto p2)
+	      {
+		return p1->max_ulps > p2->max_ulps;
+	      });
+  if (worst.size() > num_worst)
+    worst.resize(num_worst);
+
+  DynList<DynList<string>> mat;
+  mat.append(DynList<string>({ "physical quantity", "source", "target",
+	  "max ulps", "value", "mean ulps", "max rel error", "value",
+	  "failures" }));
+  for (auto rt : worst)
+    mat.append(DynList<string>({ rt->pq->name, rt->src->symbol,
+	    rt->tgt->symbol, to_string(rt->max_ulps),
+	    double_to_string(rt->max_ulps_val, precision),
+	    fixed_to_string(rt->mean_ulps, 2),
+	    double_to_string(rt->max_rel, 3),
+	    double_to_string(rt->max_rel_val, precision),
+	    to_string(rt->num_failures) }));
+
+  cout << "Seed = " << seed << endl
+       << pairs.size() << " pairs, " << pairs.size()*num_samples
+       << " round trips in " << fixed_to_string(secs, 2) << " s with "
+       << num_threads << " threads" << endl;
+  if (csv)
+    cout << to_string(format_string_csv(mat)) << endl;
+  else
+    cout << to_string(format_string(mat)) << endl;
+
+  if (num_failed > 0)
+    {
+      cout << num_failed << " pairs FAILED" << endl;
+      return 1;
+    }
+  return 0;
+}
+
 struct Epsilon
 {
   string symbol;
@@ -296,6 +502,22 @@ int main(int argc, char *argv[])
   ValueArg<size_t> d = { "d", "digits", "number of digits", false, 10,
 			 "number of digits", cmd };
 
+  SwitchArg sweep = { "S", "sweep", "round trips of all the pairs of units "
+		      "(of the physical quantity if given)", cmd, false };
+
+  ValueArg<size_t> sweep_samples = { "N", "sweep-samples", "number of "
+				     "samples per pair in the sweep", false,
+				     1000000, "number of samples", cmd };
+
+  ValueArg<size_t> num_threads = { "t", "threads", "number of threads of "
+				   "the sweep", false,
+				   std::max(thread::hardware_concurrency(), 1u),
+				   "number of threads", cmd };
+
+  ValueArg<size_t> num_worst = { "w", "worst", "number of worst pairs shown "
+				 "by the sweep", false, 20, "number of pairs",
+				 cmd };
+
   cmd.parse(argc, argv);
 
   if (print_pq.getValue())
@@ -306,6 +528,26 @@ int main(int argc, char *argv[])
 	});
       exit(0);
     }
+
+  if (d.isSet())
+    precision = d.getValue();
+
+  if (sweep.getValue())
+    {
+      DynList<const PhysicalQuantity*> quantities;
+      if (pm.isSet())
+	quantities.append(PhysicalQuantity::search(pm.getValue()));
+      else
+	PhysicalQuantity::quantities().for_each([&quantities] (auto p)
+						{
+						  quantities.append(p);
+						});
+      return sweep_round_trips(quantities, sweep_samples.getValue(),
+			       m.getValue(), epsilon.getValue(),
+			       seed.getValue(),
+			       std::max<size_t>(num_threads.getValue(), 1),
+			       num_worst.getValue(), csv.getValue());
+    }
 				
   if (not pm.isSet())
     {
@@ -366,9 +608,6 @@ int main(int argc, char *argv[])
 			    });
     }
 
-  if (d.isSet())
-    precision = d.getValue();
-
   DynList<DynList<string>> mat;
   if (extremes.getValue())
     mat = test_extremes_conversions(*ptr, verbose,
@@ -0,0 +1,347 @@
+# include <cstdlib>
+# include <new>
+
+# include <tclap/CmdLine.h>
+
+# include <units-list.H>
+# include <quantity-array.H>
+# include <conversion-plan.H>
+# include <conversion-cache.H>
+
+using namespace std;
+using namespace TCLAP;
+
+/* Heap allocations of the public conversion and arithmetic entry points
+
+   The global operator new is replaced by one counting the calls. Every
+   entry point is executed once (so that thread locals and function
+   statics are built) and then Num_Calls times, and its allocations per
+   call are checked.
+
+   The paths controlled by the library are asserted exactly: a count
+   different from the expected one, above or below, fails the test, so
+   that any change of their allocations must be acknowledged here.
+   These are the resolved conversions, the plans, Quantity and
+   VtlQuantity, and also the paths keyed by names and symbols as long
+   as these fit in the inline buffer of std::string (psia and kPa do);
+   all of them allocate nothing.
+
+   The paths throwing exceptions build their messages with
+   ostringstream, so their counts depend on the standard library and
+   not on the library. They are checked separately against a
+   tolerance (the counts of libstdc++), which is an upper bound: the
+   test fails if they exceed it and reports the tolerances that may be
+   lowered. With -x they are not checked. The exception objects
+   themselves are allocated by the C++ runtime without operator new
+   and are not counted.
+*/
+
+static size_t num_allocs = 0;
+
+void * operator new (size_t size)
+{
+  void * ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr)
+    throw bad_alloc();
+  ++num_allocs;
+  return ptr;
+}
+
+void * operator new[] (size_t size) { return operator new (size); }
+
+// the replaced operator new allocates with malloc()
+# if defined(__GNUC__) && __GNUC__ >= 11
+#   pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+# endif
+
+void operator delete (void * ptr) noexcept { free(ptr); }
+
+void operator delete[] (void * ptr) noexcept { free(ptr); }
+
+void operator delete (void * ptr, size_t) noexcept { free(ptr); }
+
+void operator delete[] (void * ptr, size_t) noexcept { free(ptr); }
+
+static constexpr size_t Num_Calls = 16;
+
+volatile double sink; // keeps the results alive
+
+double mid_value(const Unit & unit) { return (unit.min_val + unit.max_val)/2; }
+
+struct Result
+{
+  string name;
+  size_t expected; // exact count or tolerance
+  double per_call;
+};
+
+vector<Result> exact_results, tolerance_results;
+
+// Execute op and return its allocations per call
+template <class Op>
+double allocations_per_call(Op op)
+{
+  op(); // warm up
+  const size_t before = num_allocs;
+  for (size_t i = 0; i < Num_Calls; ++i)
+    op();
+  return double(num_allocs - before)/Num_Calls;
+}
+
+// Execute op, which must allocate exactly expected times per call
+template <class Op>
+void measure(const string & name, size_t expected, Op op)
+{
+  exact_results.push_back({ name, expected, allocations_per_call(op) });
+}
+
+// Execute op, which must throw E allocating at most tolerance times
+// per call
+template <class E, class Op>
+void measure_throw(const string & name, size_t tolerance, Op op)
+{
+  const double n = allocations_per_call([&name, op] ()
+    {
+      try
+	{
+	  op();
+	}
+      catch (E &)
+	{
+	  return;
+	}
+      cout << name << " did not throw" << endl;
+      abort();
+    });
+  tolerance_results.push_back({ name, tolerance, n });
+}
+
+void measure_conversions()
+{
+  const Unit & src = psia::get_instance(), & tgt = kPascal::get_instance();
+  const string src_name = src.name, tgt_name = tgt.name;
+  const string src_symbol = src.symbol, tgt_symbol = tgt.symbol;
+  const double val = mid_value(src);
+
+  measure("search_conversion", 0, [&]
+	  {
+	    sink = search_conversion(src, tgt) != nullptr;
+	  });
+  measure("exist_conversion_units", 0, [&]
+	  {
+	    sink = exist_conversion(src, tgt);
+	  });
+  measure("unit_convert_units", 0, [&]
+	  {
+	    sink = unit_convert(src, val, tgt);
+	  });
+  measure("unit_convert_typed", 0, [&]
+	  {
+	    sink = unit_convert<psia, kPascal>(val);
+	  });
+
+  measure("search_conversion_fct", 0, [&]
+	  {
+	    sink = search_conversion_fct(src_symbol, tgt_symbol) != nullptr;
+	  });
+  measure("exist_conversion_symbols", 0, [&]
+	  {
+	    sink = exist_conversion(src_symbol, tgt_symbol);
+	  });
+  measure("name_to_name", 0, [&]
+	  {
+	    sink = unit_convert_name_to_name(src_name, val, tgt_name);
+	  });
+  measure("name_to_symbol", 0, [&]
+	  {
+	    sink = unit_convert_name_to_symbol(src_name, val, tgt_symbol);
+	  });
+  measure("symbol_to_name", 0, [&]
+	  {
+	    sink = unit_convert_symbol_to_name(src_symbol, val, tgt_name);
+	  });
+  measure("symbol_to_symbol", 0, [&]
+	  {
+	    sink = unit_convert_symbol_to_symbol(src_symbol, val, tgt_symbol);
+	  });
+  measure("unit_convert_c_str", 0, [&]
+	  {
+	    sink = unit_convert("psia", "kPa", val);
+	  });
+
+  measure_throw<UnitConversionNotFound>("unit_convert_not_found", 11, [&]
+	  {
+	    sink = unit_convert(src, val, Celsius::get_instance());
+	  });
+  measure_throw<UnitConversionNotFound>("symbol_to_symbol_not_found", 11,
+					[&]
+	  {
+	    sink = unit_convert_symbol_to_symbol(src_symbol, val, "degC");
+	  });
+}
+
+void measure_plans()
+{
+  const Unit & src = psia::get_instance(), & tgt = kPascal::get_instance();
+  const ConversionPlan plan(src, tgt);
+  const ConversionPlan nonlinear(Sgw_sg::get_instance(),
+				 Molality_NaCl::get_instance());
+  const double val = mid_value(src);
+  vector<double> in(256, val), out(in.size());
+  vector<float> fin(in.size(), float(val)), fout(in.size());
+
+  measure("ConversionPlan_build", 0, [&]
+	  {
+	    sink = ConversionPlan(src, tgt).slope();
+	  });
+  measure("ConversionPlan_scalar", 0, [&] { sink = plan(val); });
+  measure("ConversionPlan_batch", 0, [&]
+	  {
+	    plan(in.data(), out.data(), in.size());
+	    sink = out[0];
+	  });
+  measure("ConversionPlan_batch_float", 0, [&]
+	  {
+	    plan(fin.data(), fout.data(), fin.size());
+	    sink = fout[0];
+	  });
+  measure("ConversionPlan_nonlinear", 0, [&]
+	  {
+	    sink = nonlinear(mid_value(Sgw_sg::get_instance()));
+	  });
+  measure("memo_convert", 0, [&]
+	  {
+	    sink = memo_convert(nonlinear,
+				mid_value(Sgw_sg::get_instance()));
+	  });
+  measure("check_values", 0, [&]
+	  {
+	    check_values(src, in.data(), in.size());
+	  });
+  measure_throw<OutOfUnitRange>("check_values_out_of_range", 9, [&]
+	  {
+	    const double bad = 2*src.max_val + 1;
+	    check_values(src, &bad, 1);
+	  });
+}
+
+void measure_quantities()
+{
+  const Unit & src = psia::get_instance(), & tgt = kPascal::get_instance();
+  const string src_name = src.name;
+  const double val = mid_value(src);
+  const Quantity<psia> q(val);
+  const VtlQuantity vq(src, val);
+
+  measure("Quantity_build", 0, [&] { sink = Quantity<psia>(val).raw(); });
+  measure("Quantity_convert", 0, [&]
+	  {
+	    sink = Quantity<kPascal>(q).raw();
+	  });
+  measure("Quantity_arithmetic", 0, [&]
+	  {
+	    sink = (q + q - q).raw();
+	  });
+  measure("Quantity_scalar_arithmetic", 0, [&]
+	  {
+	    sink = (2.0*q/2.0).raw();
+	  });
+
+  measure("VtlQuantity_build", 0, [&]
+	  {
+	    sink = VtlQuantity(src, val).raw();
+	  });
+  measure("VtlQuantity_convert", 0, [&]
+	  {
+	    sink = VtlQuantity(tgt, vq).raw();
+	  });
+  measure("VtlQuantity_arithmetic", 0, [&]
+	  {
+	    sink = (vq + vq - vq).raw();
+	  });
+  measure("VtlQuantity_scalar_arithmetic", 0, [&]
+	  {
+	    VtlQuantity r(vq);
+	    r += 1;
+	    r -= 1;
+	    sink = r.raw();
+	  });
+  measure("VtlQuantity_build_by_name", 0, [&]
+	  {
+	    sink = VtlQuantity(src_name, val).raw();
+	  });
+
+  measure_throw<OutOfUnitRange>("VtlQuantity_out_of_range", 9, [&]
+	  {
+	    sink = VtlQuantity(src, 2*src.max_val + 1).raw();
+	  });
+  measure_throw<CompoundUnitNotFound>("VtlQuantity_product_not_found", 13,
+				      [&]
+	  {
+	    sink = (vq*vq).raw();
+	  });
+}
+
+int main(int argc, char *argv[])
+{
+  CmdLine cmd(argv[0], ' ', "0");
+
+  SwitchArg print = { "p", "print", "print the allocations of every entry "
+		      "point", cmd, false };
+
+  SwitchArg no_exceptions = { "x", "no-exceptions", "do not check the "
+			      "exception paths (standard library dependent)",
+			      cmd, false };
+
+  cmd.parse(argc, argv);
+
+  measure_conversions();
+  measure_plans();
+  measure_quantities();
+
+  bool ok = true;
+  cout << "Library paths (exact counts):" << endl;
+  for (const auto & r : exact_results)
+    {
+      const bool differs = r.per_call != r.expected;
+      ok = ok and not differs;
+      if (differs)
+	cout << "    " << r.name << " allocates " << r.per_call
+	     << " times per call (expected exactly " << r.expected << ")"
+	     << endl;
+      else if (print.getValue())
+	cout << "    " << r.name << " allocates " << r.per_call
+	     << " times per call" << endl;
+    }
+
+  if (not no_exceptions.getValue())
+    {
+      cout << "Exception paths (ostringstream messages; tolerances of "
+	   << "libstdc++):" << endl;
+      for (const auto & r : tolerance_results)
+	{
+	  const bool over = r.per_call > r.expected;
+	  ok = ok and not over;
+	  if (over)
+	    cout << "    " << r.name << " allocates " << r.per_call
+		 << " times per call (tolerance = " << r.expected << ")"
+		 << endl;
+	  else if (r.per_call < r.expected)
+	    cout << "    " << r.name << " allocates " << r.per_call
+		 << " times per call; its tolerance of " << r.expected
+		 << " may be lowered" << endl;
+	  else if (print.getValue())
+	    cout << "    " << r.name << " allocates " << r.per_call
+		 << " times per call" << endl;
+	}
+    }
+
+  if (not ok)
+    {
+      cout << "FAILED" << endl;
+      return 1;
+    }
+
+  cout << "All tests passed" << endl;
+  return 0;
+}
@@ -0,0 +1,319 @@
+# include <gsl/gsl_rng.h>
+# include <ctime>
+# include <memory>
+# include <limits>
+# include <fstream>
+# include <map>
+
+# include <tclap/CmdLine.h>
+
+# include <ah-stl-utils.H>
+
+# include <units-list.H>
+
+using namespace std;
+using namespace TCLAP;
+
+/* Consistency of the conversions of every physical quantity
+
+   For every triangle (A, B, C) of distinct units of a physical
+   quantity, the direct conversion A -> C is compared with the composed
+   one A -> B -> C on nsamples uniform values of the range of A
+   (limited to max). The registered conversion functions are called
+   directly over arrays (not through ConversionPlan, whose affine
+   coefficients are probed and would add their own error); the values
+   A -> B and A -> C are computed once per source unit and reused for
+   all the triangles starting at it.
+
+   The discrepancy of a sample is |composed - direct| divided by
+   max(|direct|, floor*span(C)), where span(C) is the width of the
+   range of C; the floor keeps the values converted close to zero
+   (offsets of temperatures and gauge pressures) from dominating and
+   the maximum from depending on how close to zero a sample falls. A
+   triangle fails when its maximum discrepancy exceeds the tolerance,
+   which by default is small enough for the rounding of the constants
+   written with 7 or 8 significant digits (such as lb/ft*h -> lb/ft*s)
+   to be reported.
+
+   The discrepancies greater than tolerance/Baseline_Slack when a
+   baseline is written (-W) are accepted when it is read (-b) as long
+   as they do not grow more than Baseline_Slack times (the margin
+   absorbs the variation of the maximum between seeds); so only new or
+   worse discrepancies fail. Given with -b, -W keeps the maximum of both
+   so that a baseline is accumulated over several seeds. The
+   baseline of the current unit headers is tests/consistency-baseline.csv
+   and a change of a unit header is checked with
+
+       test-consistency -b consistency-baseline.csv
+
+   which must be rewritten (-W) when a discrepancy is fixed.
+
+   The exit code is 1 if some triangle failed or some conversion is
+   missing.
+*/
+
+static constexpr double Baseline_Slack = 2;
+
+struct Triangle
+{
+  const PhysicalQuantity * pq;
+  const Unit * a;
+  const Unit * b;
+  const Unit * c;
+  double max_err;
+  double max_err_val; // sample of A with the maximum discrepancy
+  double direct;
+  double composed;
+  double baseline; // accepted discrepancy or 0
+};
+
+// Convert the n values of in through fct and put them in out
+static void convert(Unit_Convert_Fct_Ptr fct, const double * in, double * out,
+		    size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    out[i] = (*fct)(in[i]);
+}
+
+// the discrepancies of the triangles of pq; the missing conversions
+// are added to missing
+void check_quantity(const PhysicalQuantity & pq, size_t nsamples, double max,
+		    double floor, gsl_rng * r, vector<Triangle> & triangles,
+		    vector<string> & missing)
+{
+  vector<const Unit*> units;
+  for (auto u : pq.units())
+    units.push_back(u);
+  const size_t n = units.size();
+
+  // fcts[i*n + j] converts units[i] to units[j]
+  vector<Unit_Convert_Fct_Ptr> fcts(n*n, nullptr);
+  for (size_t i = 0; i < n; ++i)
+    for (size_t j = 0; j < n; ++j)
+      {
+	if (i == j)
+	  continue;
+	fcts[i*n + j] = search_conversion(*units[i], *units[j]);
+	if (fcts[i*n + j] == nullptr)
+	  missing.push_back(units[i]->symbol + " -> " + units[j]->symbol);
+      }
+
+  vector<double> samples(nsamples), composed(nsamples);
+  vector<vector<double>> direct(n, vector<double>(nsamples));
+  for (size_t ia = 0; ia < n; ++ia)
+    {
+      const Unit & a = *units[ia];
+      const double urange = std::min(a.max_val - a.min_val, max);
+      for (size_t k = 0; k < nsamples; ++k)
+	samples[k] = a.min_val + urange*gsl_rng_uniform(r);
+
+      for (size_t j = 0; j < n; ++j)
+	if (j == ia)
+	  direct[j] = samples;
+	else if (fcts[ia*n + j] != nullptr)
+	  convert(fcts[ia*n + j], samples.data(), direct[j].data(), nsamples);
+
+      for (size_t ib = 0; ib < n; ++ib)
+	for (size_t ic = 0; ic < n; ++ic)
+	  {
+	    if (ib == ia or ic == ia or ic == ib)
+	      continue;
+	    const Unit_Convert_Fct_Ptr bc = fcts[ib*n + ic];
+	    if (fcts[ia*n + ib] == nullptr or bc == nullptr or
+		fcts[ia*n + ic] == nullptr)
+	      continue;
+
+	    convert(bc, direct[ib].data(), composed.data(), nsamples);
+
+	    const Unit & c = *units[ic];
+	    const double min_scale = floor*(c.max_val - c.min_val);
+	    const vector<double> & d = direct[ic];
+	    Triangle t = { &pq, &a, units[ib], &c, 0, 0, 0, 0, 0 };
+	    for (size_t k = 0; k < nsamples; ++k)
+	      {
+		const double err = fabs(composed[k] - d[k])/
+		  std::max(fabs(d[k]), min_scale);
+		if (err > t.max_err or (isnan(err) and not isnan(t.max_err)))
+		  {
+		    t.max_err = err;
+		    t.max_err_val = samples[k];
+		    t.direct = d[k];
+		    t.composed = composed[k];
+		  }
+	      }
+	    triangles.push_back(t);
+	  }
+    }
+}
+
+static string triangle_key(const string & pq, const string & a,
+			   const string & b, const string & c)
+{
+  return pq + "," + a + "," + b + "," + c;
+}
+
+// Read the baseline csv written by write_baseline(): key -> discrepancy
+map<string, double> read_baseline(const string & file_name)
+{
+  ifstream in(file_name);
+  if (not in)
+    {
+      cout << "Cannot open " << file_name << endl;
+      abort();
+    }
+
+  map<string, double> ret;
+  string line;
+  getline(in, line); // header
+  while (getline(in, line))
+    {
+      const size_t pos = line.rfind(',');
+      if (pos == string::npos)
+	{
+	  cout << "Invalid baseline line " << line << endl;
+	  abort();
+	}
+      ret[line.substr(0, pos)] = stod(line.substr(pos + 1));
+    }
+  return ret;
+}
+
+// Write the triangles whose discrepancy is close to or exceeds
+// tolerance; the discrepancy written is the maximum with the one in old
+void write_baseline(const string & file_name,
+		    const vector<Triangle> & triangles, double tolerance,
+		    const map<string, double> & old)
+{
+  ofstream out(file_name);
+  if (not out)
+    {
+      cout << "Cannot open " << file_name << endl;
+      abort();
+    }
+
+  out << "physical quantity,A,B,C,max discrepancy" << endl;
+  for (const auto & t : triangles)
+    {
+      const string key =
+	triangle_key(t.pq->name, t.a->symbol, t.b->symbol, t.c->symbol);
+      auto it = old.find(key);
+      const double err =
+	it == old.end() ? t.max_err : std::max(t.max_err, it->second);
+      if (not (err <= tolerance/Baseline_Slack))
+	out << key << "," << double_to_string(err, 3) << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  CmdLine cmd(argv[0], ' ', "0");
+
+  vector<string> pq = to_vector(PhysicalQuantity::names());
+  ValuesConstraint<string> allowed(pq);
+  ValueArg<string> pm = { "Q", "physical-quantity", "name of physical "
+			  "quantity (default: all)", false, "", &allowed, cmd };
+
+  ValueArg<size_t> nsamples = { "n", "num-samples", "number of samples of "
+				"every source unit", false, 4096,
+				"number of samples", cmd };
+
+  ValueArg<double> m = { "m", "max", "maximum range of a unit", false, 1000,
+			 "maximum range of a unit", cmd };
+
+  ValueArg<double> tolerance = { "t", "tolerance", "maximum relative "
+				 "discrepancy", false, 1e-9, "tolerance", cmd };
+
+  ValueArg<double> min_scale = { "f", "floor", "minimum magnitude relative to "
+			     "the range of the target unit", false, 1e-4,
+			     "ratio", cmd };
+
+  ValueArg<size_t> num_worst = { "w", "worst", "number of worst triangles "
+				 "shown", false, 20, "number of triangles",
+				 cmd };
+
+  unsigned long dft_seed = time(nullptr);
+  ValueArg<unsigned long> seed = { "s", "seed",
+				   "seed for random number generator",
+				   false, dft_seed, "random seed", cmd };
+
+  ValueArg<string> baseline = { "b", "baseline", "csv of the accepted "
+				"discrepancies", false, "", "file name", cmd };
+
+  ValueArg<string> write = { "W", "write-baseline", "write the "
+			     "discrepancies greater than the tolerance as "
+			     "baseline", false, "", "file name", cmd };
+
+  SwitchArg csv("c", "csv", "output in csv format", cmd, false);
+
+  cmd.parse(argc, argv);
+
+  unique_ptr<gsl_rng, decltype(gsl_rng_free)*>
+    r(gsl_rng_alloc(gsl_rng_mt19937), gsl_rng_free);
+  gsl_rng_set(r.get(), seed.getValue() % gsl_rng_max(r.get()));
+
+  vector<Triangle> triangles;
+  vector<string> missing;
+  for (auto p : PhysicalQuantity::quantities())
+    if (not pm.isSet() or p->name == pm.getValue())
+      check_quantity(*p, nsamples.getValue(), m.getValue(),
+		     min_scale.getValue(), r.get(), triangles, missing);
+
+  for (const auto & s : missing)
+    cout << "Missing conversion " << s << endl;
+
+  // the worst discrepancies first
+  stable_sort(triangles.begin(), triangles.end(),
+	      [] (const Triangle & t1, const Triangle & t2)
+	      {
+		return t1.max_err > t2.max_err or
+		  (isnan(t1.max_err) and not isnan(t2.max_err));
+	      });
+  map<string, double> accepted;
+  if (baseline.isSet())
+    accepted = read_baseline(baseline.getValue());
+
+  if (write.isSet())
+    write_baseline(write.getValue(), triangles, tolerance.getValue(),
+		   accepted);
+
+  size_t num_failed = 0, num_accepted = 0;
+  for (auto & t : triangles)
+    {
+      if (t.max_err <= tolerance.getValue())
+	continue;
+      auto it = accepted.find(triangle_key(t.pq->name, t.a->symbol,
+					   t.b->symbol, t.c->symbol));
+      if (it != accepted.end())
+	t.baseline = it->second;
+      if (t.max_err <= Baseline_Slack*t.baseline)
+	++num_accepted;
+      else
+	++num_failed;
+    }
+
+  DynList<DynList<string>> mat;
+  mat.append(DynList<string>({ "physical quantity", "A", "B", "C",
+	  "max discrepancy", "baseline", "value of A", "A -> C",
+	  "A -> B -> C" }));
+  for (size_t i = 0; i < std::min(triangles.size(), num_worst.getValue()); ++i)
+    {
+      const Triangle & t = triangles[i];
+      mat.append(DynList<string>({ t.pq->name, t.a->symbol, t.b->symbol,
+	      t.c->symbol, double_to_string(t.max_err, 3),
+	      t.baseline > 0 ? double_to_string(t.baseline, 3) : "-",
+	      double_to_string(t.max_err_val, 10),
+	      double_to_string(t.direct, 10),
+	      double_to_string(t.composed, 10) }));
+    }
+
+  cout << "Seed = " << seed.getValue() << endl
+       << triangles.size() << " triangles, " << num_failed + num_accepted
+       << " with discrepancy greater than " << tolerance.getValue() << " ("
+       << num_accepted << " accepted by the baseline)" << endl;
+  if (csv.getValue())
+    cout << to_string(format_string_csv(mat)) << endl;
+  else
+    cout << to_string(format_string(mat)) << endl;
+
+  return num_failed == 0 and missing.empty() ? 0 : 1;
+}
@@ -0,0 +1,501 @@
+# include <gsl/gsl_rng.h>
+# include <ctime>
+# include <memory>
+# include <limits>
+
+# include <tclap/CmdLine.h>
+
+# include <units-list.H>
+# include <quantity-array.H>
+# include <ingest.H>
+# include <conversion-chain.H>
+# include <conversion-cache.H>
+# include <arrow-ipc.H>
+
+using namespace std;
+using namespace TCLAP;
+
+// verify that the plan gives the same results than unit_convert() for
+// every registered pair of every physical quantity. Affine plans are
+// allowed to differ in a few ulps and float conversions must respect
+// the documented bound; the scalar interface and the batches (of any
+// size) must give exactly the same bits
+bool test_exact_plans(size_t nsamples, gsl_rng * r, bool verbose)
+{
+  static const double dtol = 64*numeric_limits<double>::epsilon();
+  static const double ftol = 3*numeric_limits<float>::epsilon()/2;
+  bool ok = true;
+  size_t num_affine = 0, num_plans = 0;
+  for (auto src_unit : Unit::units())
+    for (auto tgt_unit : src_unit->family_units())
+      {
+	if (not exist_conversion(*src_unit, *tgt_unit))
+	  continue;
+
+	ConversionPlan plan(*src_unit, *tgt_unit);
+	++num_plans;
+	num_affine += plan.is_affine();
+	const double urange = src_unit->max_val - src_unit->min_val;
+	vector<double> in(nsamples), out(nsamples);
+	vector<float> fin(nsamples), fout(nsamples);
+	for (size_t i = 0; i < nsamples; ++i)
+	  {
+	    fin[i] = src_unit->min_val + urange*gsl_rng_uniform(r);
+	    in[i] = fin[i];
+	  }
+	plan(in.data(), out.data(), nsamples);
+	plan(fin.data(), fout.data(), nsamples);
+
+	for (size_t i = 0; i < nsamples; ++i)
+	  {
+	    const double expected = unit_convert(*src_unit, in[i], *tgt_unit);
+	    const double scale = plan.is_affine() ?
+	      fabs(plan.slope()*in[i]) + fabs(plan.offset()) :
+	      fabs(expected);
+	    const double scalar = plan(in[i]);
+	    double single;
+	    plan(&in[i], &single, 1);
+	    const bool scalar_ok = plan.is_affine() ?
+	      fabs(scalar - expected) <= dtol*scale : scalar == expected;
+	    const bool batch_ok = out[i] == scalar and single == scalar;
+	    const bool float_ok = fabs(fout[i] - float(expected)) <=
+	      ftol*scale + fabs(float(expected) - expected);
+	    if (scalar_ok and batch_ok and float_ok)
+	      continue;
+	    cout << "Plan " << src_unit->symbol << " -> " << tgt_unit->symbol
+		 << " differs for value " << in[i] << ": expected = "
+		 << expected << " scalar = " << scalar << " batch = " << out[i]
+		 << " single = " << single << " float = " << fout[i] << endl;
+	    ok = false;
+	  }
+
+	if (verbose)
+	  cout << src_unit->symbol << " -> " << tgt_unit->symbol
+	       << (plan.is_affine() ? " (affine)" : "") << " ok" << endl;
+      }
+
+  cout << num_plans << " plans tested (" << num_affine << " affine)" << endl;
+
+  return ok;
+}
+
+// QuantityArray must convert as the plans do and reject out of range
+// values
+bool test_quantity_array()
+{
+  bool ok = true;
+  QuantityArray<psia, float> p = vector<float>({ 14.7, 100, 2500 });
+  QuantityArray<kPascal, float> kp = p;
+  for (size_t i = 0; i < p.size(); ++i)
+    if (fabs(kp[i] - unit_convert<psia, kPascal>(p[i])) > 1e-3)
+      {
+	cout << "QuantityArray conversion error for " << p[i] << endl;
+	ok = false;
+      }
+
+  try
+    {
+      QuantityArray<psia> bad = vector<double>({ 14.7, -5000 });
+      cout << "QuantityArray accepted an out of range value" << endl;
+      ok = false;
+    }
+  catch (OutOfUnitRange &) { /* expected */ }
+
+  return ok;
+}
+
+// a 4-20 mA transmitter digitized in [0, 32000] counts spanning
+// [0, 3000] psig ingested in kPa and degF counts ingested in Kelvin
+// (fused paths) and SSU (not fused)
+bool test_ingest()
+{
+  bool ok = true;
+  vector<int16_t> counts = { 0, 1, 6400, 16000, 31999, 32000 };
+  vector<double> out(counts.size());
+
+  DeviceScaling pdev(psig::get_instance(), 0, 32000, 0, 3000);
+  IngestPlan pplan(pdev, kPascal::get_instance());
+  pplan(counts.data(), counts.size(), out.data());
+  for (size_t i = 0; i < counts.size(); ++i)
+    {
+      const double expected = unit_convert<psig, kPascal>(pdev(counts[i]));
+      if (fabs(out[i] - expected) > 1e-9*fabs(expected))
+	{
+	  cout << "Ingest of count " << counts[i] << " gives " << out[i]
+	       << " instead of " << expected << endl;
+	  ok = false;
+	}
+    }
+
+  vector<uint16_t> tcounts = { 0, 100, 65535 };
+  DeviceScaling tdev(Fahrenheit::get_instance(), 0.01, -100);
+  IngestPlan tplan(tdev, Kelvin::get_instance());
+  tplan(tcounts.data(), tcounts.size(), out.data());
+  for (size_t i = 0; i < tcounts.size(); ++i)
+    {
+      const double expected =
+	unit_convert<Fahrenheit, Kelvin>(tdev(tcounts[i]));
+      if (fabs(out[i] - expected) > 1e-9*fabs(expected))
+	{
+	  cout << "Ingest of count " << tcounts[i] << " gives " << out[i]
+	       << " instead of " << expected << endl;
+	  ok = false;
+	}
+    }
+
+  vector<int32_t> vcounts = { 10, 1000, 100000 };
+  DeviceScaling vdev(CentiStoke::get_instance(), 0.01, 0);
+  IngestPlan vplan(vdev, SayboltUniversalViscosisty::get_instance());
+  vplan(vcounts.data(), vcounts.size(), out.data());
+  for (size_t i = 0; i < vcounts.size(); ++i)
+    if (out[i] != unit_convert<CentiStoke, SayboltUniversalViscosisty>
+	(vdev(vcounts[i])))
+      {
+	cout << "Ingest of count " << vcounts[i] << " is not exact" << endl;
+	ok = false;
+      }
+
+  if (not pplan.is_fused() or not tplan.is_fused() or vplan.is_fused())
+    {
+      cout << "Unexpected fusion of ingest plans" << endl;
+      ok = false;
+    }
+
+  try
+    {
+      vector<int16_t> bad = { 0, -20000 };
+      pplan(bad.data(), bad.size(), out.data());
+      cout << "Ingest accepted an out of range count" << endl;
+      ok = false;
+    }
+  catch (OutOfUnitRange &) { /* expected */ }
+
+  return ok;
+}
+
+// repeated conversions of a few values must hit the cache and give
+// the exact results of the library functions (not of the inline
+// template, which may be compiled with other flags than the library)
+bool test_cache()
+{
+  bool ok = true;
+  ConversionCache cache(64);
+  ConversionPlan plan(Sgw_sg::get_instance(), Molality_NaCl::get_instance());
+  const Unit & molality = Molality_NaCl::get_instance();
+  const Unit & cgl = CgL::get_instance();
+  const vector<double> vals = { 1.0, 1.01, 1.02, 1.05, 1.1 };
+  for (size_t rep = 0; rep < 10; ++rep)
+    for (double v : vals)
+      {
+	const double by_plan = cache.convert(plan, v);
+	const double by_units = cache.convert(molality, v, cgl);
+	if (by_plan != plan.function()(v) or
+	    by_units != unit_convert(molality, v, cgl))
+	  ok = false;
+      }
+
+  const auto & stats = cache.get_stats();
+  cout << "Cache: hits = " << stats.hits << " misses = " << stats.misses
+       << " hit ratio = " << stats.hit_ratio() << endl;
+  if (not ok or stats.misses > 2*vals.size() or stats.hits < 80)
+    {
+      cout << "    ERROR: unexpected cache behaviour" << endl;
+      return false;
+    }
+
+  return true;
+}
+
+// a table with a pressure column in psia encoded in both arrow
+// formats, decoded, converted to kPa and encoded again; an out of
+// range value must be rejected leaving the table unchanged
+bool test_arrow()
+{
+  bool ok = true;
+  const vector<double> vals = { 14.7, 100, 2500, 9000 };
+  ArrowTable table;
+  table.add_column("pressure", psia::get_instance(), vals.data(), vals.size());
+
+  for (bool stream : { false, true })
+    {
+      auto data = make_shared<vector<uint8_t>>(table.encode(stream));
+      ArrowTable t = ArrowTable::decode(data->data(), data->size(), data);
+      t.convert_column("pressure", kPascal::get_instance());
+      data = make_shared<vector<uint8_t>>(t.encode(stream));
+      t = ArrowTable::decode(data->data(), data->size(), data);
+
+      if (t.num_rows() != vals.size() or
+	  t.fields[0].unit() != &kPascal::get_instance())
+	{
+	  cout << "Arrow table lost its rows or unit" << endl;
+	  ok = false;
+	  continue;
+	}
+
+      const double * out =
+	reinterpret_cast<const double*>(t.batches[0].columns[0].buffers[1].data);
+      for (size_t i = 0; i < vals.size(); ++i)
+	if (out[i] != unit_convert<psia, kPascal>(vals[i]))
+	  {
+	    cout << "Arrow conversion of " << vals[i] << " gives " << out[i]
+		 << endl;
+	    ok = false;
+	  }
+    }
+
+  const vector<double> bad = { 1, -5000, 3, 4 };
+  table.add_column("bad", psia::get_instance(), vals.data(), vals.size());
+  auto col = make_shared<vector<double>>(bad);
+  table.batches[0].columns[1].buffers[1].data =
+    reinterpret_cast<const uint8_t*>(col->data());
+  table.batches[0].columns[1].buffers[1].owner = col;
+  try
+    {
+      table.convert_column("bad", kPascal::get_instance());
+      cout << "Arrow conversion accepted an out of range value" << endl;
+      ok = false;
+    }
+  catch (OutOfUnitRange &)
+    {
+      if (table.fields[1].unit() != &psia::get_instance())
+	{
+	  cout << "Failed arrow conversion modified the table" << endl;
+	  ok = false;
+	}
+    }
+
+  return ok;
+}
+
+// constants of the steps of the tested chains as they are written in
+// the unit headers; the step is y = scale*(x + shift)
+struct StepConstants
+{
+  const Unit * src;
+  const Unit * tgt;
+  long double scale;
+  long double shift;
+};
+
+static const StepConstants * search_step(const Unit * src, const Unit * tgt)
+{
+  static const StepConstants steps[] =
+    {
+      { &mP::get_instance(), &Poise::get_instance(), 1/1e6L, 0 },
+      { &Poise::get_instance(), &Paxs::get_instance(), 0.1L, 0 },
+      { &lb_ftxh::get_instance(), &Poise::get_instance(), 0.0041337890L, 0 },
+      { &Poise::get_instance(), &mP::get_instance(), 1e6L, 0 },
+      { &mP::get_instance(), &lb_ftxs::get_instance(), 6.719689751e-8L, 0 },
+      { &psig::get_instance(), &Pascal::get_instance(), 6894.757293178308L,
+	14.695948775L },
+      { &Pascal::get_instance(), &kPascal::get_instance(), 1/1000.0L, 0 },
+      { &kPascal::get_instance(), &Bar::get_instance(), 1.0e-2L, 0 },
+    };
+  for (const auto & s : steps)
+    if (s.src == src and s.tgt == tgt)
+      return &s;
+  return nullptr;
+}
+
+/* The chain is compared against the composition of the constants of
+   the unit headers evaluated in long double, which is independent of
+   the coefficients probed by the plans. The chain rounds the decimal
+   constants once when they are compiled and once more when its plans
+   probe them, so it is not correctly rounded with respect to that
+   reference; its error must stay within Max_Chain_Ulps per step, as documented
+   in conversion-chain.H. The
+   errors are measured in ulps of |scale*(x + shift)| accumulated
+   without cancellation, since the offsets may cancel the value */
+static constexpr double Max_Chain_Ulps = 1;
+
+bool test_chain(const DynList<const Unit *> & path, size_t nsamples,
+		gsl_rng * r)
+{
+  ConversionChain chain(path);
+  const Unit & src = chain.source_unit();
+  ConversionPlan direct(src, chain.target_unit());
+
+  vector<const StepConstants*> steps;
+  const Unit * prev = nullptr;
+  for (auto it = path.get_it(); it.has_curr(); it.next())
+    {
+      if (prev != nullptr)
+	{
+	  const StepConstants * step = search_step(prev, it.get_curr());
+	  if (step == nullptr)
+	    {
+	      cout << "Chain step " << prev->symbol << " -> "
+		   << it.get_curr()->symbol << " has not reference constants"
+		   << endl;
+	      return false;
+	    }
+	  steps.push_back(step);
+	}
+      prev = it.get_curr();
+    }
+
+  double chain_err = 0, stepwise_err = 0, direct_err = 0;
+  for (size_t i = 0; i < nsamples; ++i)
+    {
+      const double v = src.min_val + (src.max_val - src.min_val)*
+	gsl_rng_uniform(r);
+      long double ref = v, mag = fabs(v);
+      for (auto step : steps)
+	{
+	  ref = step->scale*(ref + step->shift);
+	  mag = fabsl(step->scale)*(mag + fabsl(step->shift));
+	}
+      const double ulp = nextafter(double(mag), HUGE_VAL) - double(mag);
+      auto err = [ref, ulp] (double y) { return double(fabsl(y - ref))/ulp; };
+      chain_err = std::max(chain_err, err(chain(v)));
+      stepwise_err = std::max(stepwise_err, err(chain.stepwise(v)));
+      direct_err = std::max(direct_err, err(direct(v)));
+    }
+
+  cout << "Chain " << src.symbol << " -> " << chain.target_unit().symbol
+       << " (" << chain.size() << " steps): max error in ulps: "
+       << "double-double = " << chain_err << " stepwise = " << stepwise_err
+       << " direct = " << direct_err << endl;
+
+  if (not chain.is_affine() or chain_err > Max_Chain_Ulps*chain.size())
+    {
+      cout << "    ERROR: chain error is greater than "
+	   << Max_Chain_Ulps*chain.size() << " ulps" << endl;
+      return false;
+    }
+
+  return true;
+}
+
+// build a table for src -> tgt on [lo, hi] and verify that the
+// reported error is really an upper bound on a random sample
+bool test_table(const Unit & src, const Unit & tgt, double lo, double hi,
+		size_t num_knots, double tolerance, size_t nsamples,
+		gsl_rng * r)
+{
+  bool ok = true;
+  for (auto interp : { ConversionPlan::Interpolation::Linear,
+	ConversionPlan::Interpolation::Cubic })
+    {
+      const char * iname =
+	interp == ConversionPlan::Interpolation::Linear ? "linear" : "cubic";
+
+      ConversionPlan uplan(src, tgt), aplan(src, tgt);
+      const double uerr = uplan.use_table(lo, hi, num_knots, interp);
+      const double aerr = aplan.use_adaptive_table(lo, hi, tolerance, interp);
+
+      double umax = 0, amax = 0;
+      for (size_t i = 0; i < nsamples; ++i)
+	{
+	  const double v = lo + (hi - lo)*gsl_rng_uniform(r);
+	  const double exact = unit_convert(src, v, tgt);
+	  umax = std::max(umax, fabs(uplan(v) - exact));
+	  amax = std::max(amax, fabs(aplan(v) - exact));
+	  double ubatch, abatch;
+	  uplan(&v, &ubatch, 1);
+	  aplan(&v, &abatch, 1);
+	  if (ubatch != uplan(v) or abatch != aplan(v))
+	    {
+	      cout << "    ERROR: batch and scalar differ for " << v << endl;
+	      ok = false;
+	    }
+	}
+
+      cout << src.symbol << " -> " << tgt.symbol << " " << iname << endl
+	   << "    uniform  " << uplan.get_table()->num_knots()
+	   << " knots: reported error = " << uerr << " sampled = " << umax
+	   << endl
+	   << "    adaptive " << aplan.get_table()->num_knots()
+	   << " knots: reported error = " << aerr << " sampled = " << amax
+	   << endl;
+
+      // the reported error comes from a sample, so a small slack is
+      // allowed
+      if (umax > 2*uerr + 1e-12 or amax > 2*aerr + 1e-12)
+	{
+	  cout << "    ERROR: sampled error exceeds the reported one" << endl;
+	  ok = false;
+	}
+    }
+
+  return ok;
+}
+
+// affine plans must refuse the lookup tables
+bool test_affine_table()
+{
+  ConversionPlan plan(psia::get_instance(), kPascal::get_instance());
+  try
+    {
+      plan.use_table(100, 200, 16);
+      cout << "Affine plan accepted a lookup table" << endl;
+      return false;
+    }
+  catch (InvalidConversionTable &) { /* expected */ }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  CmdLine cmd(argv[0], ' ', "0");
+
+  ValueArg<size_t> nsamples = { "n", "num-samples",
+				"number of random samples", false,
+				1000, "number of samples", cmd };
+
+  unsigned long dft_seed = time(nullptr);
+  ValueArg<unsigned long> seed = { "s", "seed",
+				   "seed for random number generator",
+				   false, dft_seed, "random seed", cmd };
+
+  ValueArg<size_t> knots = { "k", "knots", "knots of uniform tables", false,
+			     256, "number of knots", cmd };
+
+  ValueArg<double> tol = { "t", "tolerance", "tolerance of adaptive tables",
+			   false, 1e-9, "tolerance", cmd };
+
+  SwitchArg ver = { "v", "verbose", "verbose mode", cmd, false };
+
+  cmd.parse(argc, argv);
+
+  unique_ptr<gsl_rng, decltype(gsl_rng_free)*>
+    r(gsl_rng_alloc(gsl_rng_mt19937), gsl_rng_free);
+  gsl_rng_set(r.get(), seed.getValue() % gsl_rng_max(r.get()));
+
+  cout << "Seed = " << seed.getValue() << endl;
+
+  bool ok = test_exact_plans(nsamples.getValue(), r.get(), ver.getValue());
+  ok = test_quantity_array() and ok;
+  ok = test_ingest() and ok;
+  ok = test_cache() and ok;
+  ok = test_arrow() and ok;
+  ok = test_chain({ &mP::get_instance(), &Poise::get_instance(),
+	&Paxs::get_instance() }, nsamples.getValue(), r.get()) and ok;
+  ok = test_chain({ &lb_ftxh::get_instance(), &Poise::get_instance(),
+	&mP::get_instance(), &lb_ftxs::get_instance() },
+    nsamples.getValue(), r.get()) and ok;
+  ok = test_chain({ &psig::get_instance(), &Pascal::get_instance(),
+	&kPascal::get_instance(), &Bar::get_instance() },
+    nsamples.getValue(), r.get()) and ok;
+
+  ok = test_affine_table() and ok;
+  ok = test_table(Sgw_sg::get_instance(), Molality_NaCl::get_instance(),
+		  1.0, 1.1, knots.getValue(), tol.getValue(),
+		  nsamples.getValue(), r.get()) and ok;
+  ok = test_table(CentiStoke::get_instance(),
+		  SayboltUniversalViscosisty::get_instance(), 1, 100,
+		  knots.getValue(), tol.getValue(), nsamples.getValue(),
+		  r.get()) and ok;
+  ok = test_table(SayboltUniversalViscosisty::get_instance(),
+		  CentiStoke::get_instance(), 200, 1000, knots.getValue(),
+		  tol.getValue(), nsamples.getValue(), r.get()) and ok;
+
+  if (not ok)
+    {
+      cout << "FAILED" << endl;
+      return 1;
+    }
+
+  cout << "All tests passed" << endl;
+  return 0;
+}
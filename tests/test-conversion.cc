@@ -1,34 +1,21 @@
 
-# include <istream>
+# include <fcntl.h>
+# include <unistd.h>
 
 # include <ah-stl-utils.H>
 
 # include <tclap/CmdLine.h>
 # include <units-list.H>
+# include <conversion-stream.H>
 
-using namespace TCLAP;
+# include "tool-utils.H"
 
-const Unit * search_unit(const string & name)
-{
-  auto unit_ptr = Unit::search_by_name(name);
-  if (unit_ptr == nullptr)
-    {
-      unit_ptr = Unit::search_by_symbol(name);
-      if (unit_ptr == nullptr)
-	{
-	  cout << "Unit " << name << " not found" << endl;
-	  abort();
-	}
-    }
-  return unit_ptr;
-}
+using namespace TCLAP;
 
-void convert(const Unit * src_unit, const Unit * tgt_unit, istream & in)
+void convert(const Unit * src_unit, const Unit * tgt_unit, int in_fd)
 {
-  double val;
-  while (in >> val)
-    cout << unit_convert(*src_unit, val, *tgt_unit) << " ";
-  cout << endl;
+  cout.flush();
+  convert_stream(ConversionPlan(*src_unit, *tgt_unit), in_fd, STDOUT_FILENO);
 }
 
 void list_all_units()
@@ -110,6 +97,10 @@ void test(int argc, char *argv[])
   ValueArg<string> file = { "f", "file", "input file name", false, "",
 			    "input file name", cmd };
   SwitchArg pipe = { "p", "pipe", "input by cin", cmd };
+  ValueArg<size_t> threads = { "t", "threads",
+			       "number of threads converting the input file "
+			       "(0 for all the hardware threads)", false, 1,
+			       "number of threads", cmd };
 
   cmd.parse(argc, argv);
 
@@ -159,22 +150,30 @@ void test(int argc, char *argv[])
       if (file.isSet() or pipe.getValue())
 	{
 	  if (pipe.isSet())
-	    convert(src_ptr, tgt_ptr, cin);
+	    convert(src_ptr, tgt_ptr, STDIN_FILENO);
+	  else if (threads.getValue() != 1)
+	    {
+	      cout.flush();
+	      convert_file_parallel(ConversionPlan(*src_ptr, *tgt_ptr),
+				    file.getValue(), STDOUT_FILENO,
+				    threads.getValue());
+	    }
 	  else
 	    {
-	      ifstream in(file.getValue());
-	      if (not in.good())
+	      const int fd = open(file.getValue().c_str(), O_RDONLY);
+	      if (fd < 0)
 		{
 		  cout << "Cannot open " << file.getValue() << endl;
 		  abort();
 		}
-	      convert(src_ptr, tgt_ptr, in);
+	      convert(src_ptr, tgt_ptr, fd);
+	      close(fd);
 	    }
 	  exit(0);
 	}
 
       VtlQuantity val(*src_ptr, sample.getValue());
-      cout << VtlQuantity(*tgt_ptr, val).raw() << endl;
+      cout << double_to_string(VtlQuantity(*tgt_ptr, val).raw()) << endl;
       exit(0);
     }
 
@@ -214,6 +213,16 @@ void test(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
-  test(argc, argv);
+  try
+    {
+      test(argc, argv);
+    }
+  catch (ZenException & e)
+    {
+      cout.flush();
+      cout << endl << e.type << ": " << e.msg << " (" << e.file_name << ":"
+	   << e.line_number << ")" << endl;
+      return 1;
+    }
   return 0;
 }
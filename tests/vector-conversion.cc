@@ -1,11 +1,27 @@
-
-# include <istream>
+# include <fcntl.h>
+# include <unistd.h>
 
 # include <tclap/CmdLine.h>
 # include <units-list.H>
+# include <conversion-stream.H>
+# include <binary-conversion.H>
+
+# include "tool-utils.H"
 
 using namespace TCLAP;
 
+/* Conversion of many values between two units
+
+   The values are taken from the command line or, if there are none,
+   from the files given with -f (or the standard input). Text input is
+   a sequence of numbers separated by blanks; with -b the input is a
+   sequence of raw little-endian doubles (floats with -F) and the
+   output is written in the same format.
+
+   The conversion is resolved once as a plan and the values are
+   converted in batches; the output is written in large blocks.
+*/
+
 CmdLine cmd = { "vector-conversion", ' ', "0" };
 
 ValueArg<string> source = {"S", "source-unit", "source unit", true,
@@ -13,33 +29,113 @@ ValueArg<string> source = {"S", "source-unit", "source unit", true,
 ValueArg<string> target = {"T", "target-unit", "target unit", true,
 			   "", "target unit", cmd};
 
-UnlabeledMultiArg<double> vals = { "values", "list of values to convert", true,
-				   "list of values to convert", cmd };
+MultiArg<string> files = { "f", "file", "input file (stdin if there are "
+			   "neither values nor files)", false, "file name",
+			   cmd };
+
+SwitchArg binary = { "b", "binary", "input and output are raw little-endian "
+		     "values", cmd, false };
+
+SwitchArg single = { "F", "float", "binary values are float instead of double",
+		     cmd, false };
+
+ValueArg<int> precision = { "P", "precision",
+			    "significant digits of the converted values",
+			    false, 6, "precision", cmd };
+
+UnlabeledMultiArg<string> vals = { "values", "list of values to convert",
+				   false, "list of values to convert", cmd };
 
-const Unit * search_unit(const string & name)
+int open_or_abort(const string & name)
 {
-  auto unit_ptr = Unit::search_by_name(name);
-  if (unit_ptr == nullptr)
+  const int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0)
     {
-      unit_ptr = Unit::search_by_symbol(name);
-      if (unit_ptr == nullptr)
-	{
-	  cout << "Unit " << name << " not found" << endl;
-	  abort();
-	}
+      cout << "Cannot open " << name << endl;
+      abort();
     }
-  return unit_ptr;
+  return fd;
+}
+
+// Convert the raw values read from in_fd and write them in out_fd
+template <typename T>
+void convert_binary(const ConversionPlan & plan, int in_fd, int out_fd)
+{
+  const size_t block_vals = (1 << 20)/sizeof(T);
+  vector<T> buf(block_vals);
+  char * const bytes = reinterpret_cast<char*>(buf.data());
+  size_t len = 0; // bytes in buf
+  bool eof = false;
+  while (not eof)
+    {
+      const size_t n = read_some(in_fd, bytes + len, block_vals*sizeof(T) - len);
+      len += n;
+      eof = n == 0;
+
+      const size_t num_vals = len/sizeof(T);
+      if (num_vals < block_vals and not eof)
+	continue; // fill the block before converting it
+
+      convert_array_inplace(plan, buf.data(), num_vals, 1);
+      write_fully(out_fd, bytes, num_vals*sizeof(T));
+
+      len -= num_vals*sizeof(T);
+      memmove(bytes, bytes + num_vals*sizeof(T), len);
+    }
+
+  if (len > 0)
+    {
+      ostringstream s;
+      s << "input ends with a partial value of " << len << " bytes";
+      ZENTHROW(InvalidValue, s.str());
+    }
+}
+
+void convert_fd(const ConversionPlan & plan, int in_fd)
+{
+  if (not binary.getValue())
+    convert_stream(plan, in_fd, STDOUT_FILENO, precision.getValue());
+  else if (single.getValue())
+    convert_binary<float>(plan, in_fd, STDOUT_FILENO);
+  else
+    convert_binary<double>(plan, in_fd, STDOUT_FILENO);
 }
 
 void convert()
 {
   auto src_unit = search_unit(source.getValue());
   auto tgt_unit = search_unit(target.getValue());
-  auto convert_fct = search_conversion(*src_unit, *tgt_unit);
+  if (search_conversion(*src_unit, *tgt_unit) == nullptr)
+    {
+      cout << "Conversion from " << src_unit->name << " to "
+	   << tgt_unit->name << " has not been registered" << endl;
+      abort();
+    }
+  const ConversionPlan plan(*src_unit, *tgt_unit);
 
-  for (auto v : vals)
-    cout << (*convert_fct)(v) << " ";
-  cout << endl;
+  if (not vals.getValue().empty())
+    {
+      TextConverter conv(plan, precision.getValue());
+      for (const auto & v : vals.getValue())
+	conv.convert(v.data(), v.data() + v.size());
+      conv.flush();
+      conv.append('\n');
+      write_fully(STDOUT_FILENO, conv.data(), conv.size());
+      return;
+    }
+
+  if (files.getValue().empty())
+    {
+      convert_fd(plan, STDIN_FILENO);
+      return;
+    }
+
+  for (const auto & name : files.getValue())
+    {
+      const int fd = open_or_abort(name);
+      convert_fd(plan, fd);
+      close(fd);
+    }
 }
 
 int main(int argc, char *argv[])